@@ -0,0 +1,346 @@
+#pragma once
+
+#include "board.h"
+#include "matching.h"
+#include "position.h"
+#include "reachability.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace sstm {
+
+	//Produces the predecessors of a position: every pull the player can make, reported as the box cell
+	//before the pull and the direction the box moves in. Boxes are never pulled onto cells no initial box
+	//can be pushed to, the backward counterpart of dead squares.
+	class PullGenerator {
+	private:
+		const Board &board;
+
+		Reachability reachability;
+		Reachability child_reachability;
+
+		//Assigns boxes to the initial boxes, computed for the expanded position on first use.
+		MatchingLowerBound matching;
+		bool is_matching_current = false;
+		MatchingLowerBound child_matching;
+		std::vector<Cell> parent_boxes;
+
+		std::vector<std::uint8_t> dead_for_pulls;
+
+		void compute_dead_for_pulls() {
+			dead_for_pulls.assign(board.number_of_cells(), 1);
+			for (auto cell = Cell{}; cell < board.number_of_cells(); ++cell) {
+				for (auto index = size_t{}; index < board.get_initial_boxes().size(); ++index) {
+					if (board.pull_distance(cell, index) != Board::unreachable) {
+						dead_for_pulls[cell] = 0;
+						break;
+					}
+				}
+			}
+		}
+
+	public:
+		explicit PullGenerator(const Board &_board) :
+			board{_board},
+			matching{_board, MatchingTargets::InitialBoxes},
+			child_matching{_board, MatchingTargets::InitialBoxes}
+		{
+			compute_dead_for_pulls();
+		}
+
+		[[nodiscard]] auto lower_bound_of(const Position &position) -> std::optional<std::uint32_t> {
+			matching.assign_all(position.get_boxes());
+			is_matching_current = false;
+			return matching.get_lower_bound();
+		}
+
+		//Calls visit(pull, 1, normalized_player, compute_lower_bound) for each predecessor, while the position
+		//holds it. The length is there to match SuccessorGenerator::for_each_child, pulls have no macros.
+		template<typename Visit>
+		void for_each_parent(Position &position, SolverStatistics &statistics, const Visit &visit) {
+			++statistics.expanded_nodes;
+
+			reachability.compute(position, position.player);
+			is_matching_current = false;
+
+			for (auto i = size_t{}; i < position.get_boxes().size(); ++i) {
+				auto box = position.get_boxes()[i];
+				for (auto direction : all_directions) {
+					auto target = board.neighbor(box, direction);
+					if (!reachability.contains(target) || dead_for_pulls[target]) {
+						continue;
+					}
+					auto stand = board.neighbor(target, direction);
+					if (!position.is_free(stand)) {
+						continue;
+					}
+
+					position.move_box(i, target);
+					child_reachability.compute(position, stand);
+					visit(Push{box, direction}, std::uint32_t{1}, child_reachability.normalized(), [&]() {
+						if (!is_matching_current) {
+							parent_boxes = position.get_boxes();
+							parent_boxes[i] = box;
+							matching.assign_all(parent_boxes);
+							is_matching_current = true;
+						}
+						child_matching = matching;
+						child_matching.move_box(i, target);
+						return child_matching.get_lower_bound();
+					});
+					position.move_box(i, box);
+				}
+			}
+		}
+	};
+
+	//Bidirectional A*: pushes forward from the level towards the goals and pulls backward from the solved
+	//configurations (one per region the player can end up in) towards the initial boxes, each side guided
+	//by its own matching. Every state a side stores is looked up in the other side's table, and a hit joins
+	//the two halves into a solution. Search stops once neither side can beat the best join any more, so the
+	//result is push-optimal.
+	class BidirectionalSolver {
+	private:
+		struct Node {
+			std::uint64_t hash;
+			std::uint32_t parent;
+			std::uint32_t cost;
+			std::uint32_t lower_bound;
+			Cell player;
+			//Forward nodes store the push that led here, backward nodes the pull.
+			Cell moved_box;
+			Direction direction;
+			bool closed;
+		};
+
+		struct Search {
+			std::vector<Node> nodes;
+			std::vector<Cell> box_pool;
+			NodeTable table;
+			std::priority_queue<OpenEntry> open;
+
+			[[nodiscard]] auto boxes_of(std::uint32_t node, size_t number_of_boxes) const -> const Cell * {
+				return box_pool.data() + static_cast<size_t>(node) * number_of_boxes;
+			}
+
+			[[nodiscard]] auto best_estimate() const -> std::uint32_t {
+				return open.empty() ? std::numeric_limits<std::uint32_t>::max() : open.top().estimate;
+			}
+		};
+
+		static constexpr auto no_parent = std::numeric_limits<std::uint32_t>::max();
+		static constexpr auto no_solution = std::numeric_limits<std::uint32_t>::max();
+
+		const Board &board;
+		SolverOptions options;
+		size_t number_of_boxes;
+
+		Search forward;
+		Search backward;
+
+		Position position;
+		SuccessorGenerator successors;
+		PullGenerator predecessors;
+
+		//Best join so far: a forward and a backward node holding the same state.
+		std::uint32_t best_cost = no_solution;
+		std::uint32_t best_forward = no_parent;
+		std::uint32_t best_backward = no_parent;
+
+		SolverStatistics statistics;
+
+		void join(Search &search, std::uint32_t node) {
+			const auto &other = &search == &forward ? backward : forward;
+			const auto &stored = search.nodes[node];
+			const auto *boxes = search.boxes_of(node, number_of_boxes);
+
+			auto hash_of = [&](std::uint32_t index) { return other.nodes[index].hash; };
+			auto equal = [&](std::uint32_t index) {
+				return other.nodes[index].player == stored.player &&
+					std::equal(boxes, boxes + number_of_boxes, other.boxes_of(index, number_of_boxes));
+			};
+
+			auto maybe_match = other.table.find(stored.hash, hash_of, equal);
+			if (!maybe_match || stored.cost + other.nodes[*maybe_match].cost >= best_cost) {
+				return;
+			}
+			best_cost = stored.cost + other.nodes[*maybe_match].cost;
+			best_forward = &search == &forward ? node : *maybe_match;
+			best_backward = &search == &forward ? *maybe_match : node;
+		}
+
+		//Stores the current position in `search` like Solver::add_node, and joins it with the other side.
+		template<typename ComputeLowerBound>
+		void add_node(Search &search, std::uint32_t parent, std::uint32_t cost, Cell player, Push move, const ComputeLowerBound &compute_lower_bound) {
+			++statistics.generated_nodes;
+
+			auto hash = position.get_box_hash() ^ board.player_key(player);
+			auto candidate = static_cast<std::uint32_t>(search.nodes.size());
+
+			search.box_pool.resize(search.box_pool.size() + number_of_boxes);
+			position.store_sorted(search.box_pool.data() + static_cast<size_t>(candidate) * number_of_boxes);
+
+			auto hash_of = [&](std::uint32_t index) { return search.nodes[index].hash; };
+			auto equal = [&](std::uint32_t index) {
+				return search.nodes[index].player == player &&
+					std::equal(search.boxes_of(index, number_of_boxes), search.boxes_of(index, number_of_boxes) + number_of_boxes, search.boxes_of(candidate, number_of_boxes));
+			};
+
+			search.nodes.push_back(Node{hash, parent, cost, 0, player, move.box, move.direction, false});
+
+			if (auto maybe_existing = search.table.find_or_insert(hash, candidate, hash_of, equal)) {
+				search.nodes.pop_back();
+				search.box_pool.resize(search.box_pool.size() - number_of_boxes);
+
+				auto &existing = search.nodes[*maybe_existing];
+				if (existing.closed || existing.cost <= cost) {
+					return;
+				}
+				existing.parent = parent;
+				existing.cost = cost;
+				existing.moved_box = move.box;
+				existing.direction = move.direction;
+				search.open.push(OpenEntry{cost + existing.lower_bound, existing.lower_bound, cost, *maybe_existing});
+				join(search, *maybe_existing);
+				return;
+			}
+
+			auto maybe_bound = compute_lower_bound();
+			if (!maybe_bound) {
+				search.nodes.back().closed = true;
+				return;
+			}
+			search.nodes.back().lower_bound = *maybe_bound;
+			search.open.push(OpenEntry{cost + *maybe_bound, *maybe_bound, cost, candidate});
+			join(search, candidate);
+		}
+
+		void add_roots() {
+			add_node(forward, no_parent, 0, successors.normalized_player(position), Push{no_cell, Direction::Up}, [&]() {
+				return successors.lower_bound_of(position);
+			});
+
+			position.load(board.get_goals(), no_cell);
+			auto covered = std::vector<std::uint8_t>(board.number_of_cells());
+			auto region = Reachability{};
+			for (auto cell = Cell{}; cell < board.number_of_cells(); ++cell) {
+				if (covered[cell] || !position.is_free(cell)) {
+					continue;
+				}
+				region.compute(position, cell);
+				for (auto other = cell; other < board.number_of_cells(); ++other) {
+					covered[other] = covered[other] || region.contains(other);
+				}
+				add_node(backward, no_parent, 0, region.normalized(), Push{no_cell, Direction::Up}, [&]() {
+					return predecessors.lower_bound_of(position);
+				});
+			}
+		}
+
+		void expand(Search &search) {
+			auto entry = search.open.top();
+			search.open.pop();
+
+			auto &node = search.nodes[entry.node];
+			if (node.closed || node.cost != entry.cost) {
+				return;
+			}
+			node.closed = true;
+
+			position.load(search.boxes_of(entry.node, number_of_boxes), number_of_boxes, node.player);
+			auto cost = node.cost;
+			auto visit = [&](Push move, std::uint32_t length, Cell player, const auto &compute_lower_bound) {
+				add_node(search, entry.node, cost + length, player, move, compute_lower_bound);
+			};
+			if (&search == &forward) {
+				successors.for_each_child(position, statistics, visit);
+			} else {
+				predecessors.for_each_parent(position, statistics, visit);
+			}
+		}
+
+		[[nodiscard]] auto reconstruct() const -> std::optional<std::string> {
+			auto pushes = std::vector<Push>{};
+			for (auto node = best_forward; forward.nodes[node].parent != no_parent; node = forward.nodes[node].parent) {
+				pushes.push_back(Push{forward.nodes[node].moved_box, forward.nodes[node].direction});
+			}
+			std::reverse(RANGE(pushes));
+			pushes = successors.expand_macros(pushes);
+
+			//Undoing the pulls from the join back to the goals, in that order, gives the remaining pushes.
+			for (auto node = best_backward; backward.nodes[node].parent != no_parent; node = backward.nodes[node].parent) {
+				auto pull = Push{backward.nodes[node].moved_box, backward.nodes[node].direction};
+				pushes.push_back(Push{board.neighbor(pull.box, pull.direction), opposite(pull.direction)});
+			}
+			return pushes_to_lurd(board, pushes);
+		}
+
+	public:
+		BidirectionalSolver(const Board &_board, SolverOptions _options = {}) :
+			board{_board},
+			options{_options},
+			number_of_boxes{_board.get_initial_boxes().size()},
+			position{_board},
+			successors{_board, _options},
+			predecessors{_board}
+		{}
+
+		[[nodiscard]] auto run() -> SolverResult {
+			auto start = std::chrono::steady_clock::now();
+			auto result = SolverResult{};
+
+			add_roots();
+
+			while (statistics.expanded_nodes < options.max_expanded_nodes && !options.stop_token.stop_requested()) {
+				if (forward.open.empty() && options.use_macros) {
+					//Macros skip positions, so running out of pushes proves nothing. The pulls have none, and can
+					//still join the positions the pushes reached, the level itself among them.
+					if (best_cost != no_solution) {
+						result.solution = reconstruct();
+						break;
+					}
+					if (backward.open.empty()) {
+						result.proven_unsolvable = true;
+						break;
+					}
+					expand(backward);
+					continue;
+				}
+
+				//Both estimates are admissible, so no join left to find is cheaper than either side's best.
+				auto is_optimal = best_cost <= std::max(forward.best_estimate(), backward.best_estimate());
+				if (is_optimal || forward.open.empty() || backward.open.empty()) {
+					if (best_cost != no_solution) {
+						result.solution = reconstruct();
+					} else {
+						result.proven_unsolvable = true;
+					}
+					break;
+				}
+				expand(forward.open.size() <= backward.open.size() ? forward : backward);
+			}
+
+			statistics.stored_states = forward.nodes.size() + backward.nodes.size();
+			statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			result.statistics = statistics;
+			return result;
+		}
+	};
+
+	//Solves a level headlessly from both ends. Throws std::invalid_argument if the level is malformed.
+	[[nodiscard]] inline auto solve_bidirectional(Level level, SolverOptions options = {}) -> SolverResult {
+		auto board = Board{level};
+		return BidirectionalSolver{board, options}.run();
+	}
+
+} //namespace sstm
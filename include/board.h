@@ -0,0 +1,370 @@
+#pragma once
+
+#include "sokoban_parser.h"
+
+#include <cool/literals.h>
+#include <cool/algorithm.h>
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace sstm {
+
+	//Flat index into the padded cell array of a Board.
+	using Cell = std::uint16_t;
+
+	inline constexpr auto no_cell = std::numeric_limits<Cell>::max();
+
+	//Up and Down refer to the rows of the level text, so Up is what GLFW_KEY_UP does in World::move.
+	enum class Direction : std::uint8_t {Up, Down, Left, Right};
+
+	inline constexpr auto all_directions = std::array{Direction::Up, Direction::Down, Direction::Left, Direction::Right};
+
+	[[nodiscard]] constexpr auto opposite(Direction direction) -> Direction {
+		switch (direction) {
+			case Direction::Up: return Direction::Down;
+			case Direction::Down: return Direction::Up;
+			case Direction::Left: return Direction::Right;
+			case Direction::Right: return Direction::Left;
+		}
+		assert(false);
+		return direction;
+	}
+
+	//LURD notation: lower case for walking, upper case for pushing.
+	[[nodiscard]] constexpr auto to_lurd(Direction direction, bool is_push) -> char {
+		auto c = 'u';
+		switch (direction) {
+			case Direction::Up: c = 'u'; break;
+			case Direction::Down: c = 'd'; break;
+			case Direction::Left: c = 'l'; break;
+			case Direction::Right: c = 'r'; break;
+		}
+		return is_push ? static_cast<char>(c - 'a' + 'A') : c;
+	}
+
+	//The direction of a LURD move, push or not, or nullopt for any other character.
+	[[nodiscard]] constexpr auto from_lurd(char c) -> std::optional<Direction> {
+		switch (c) {
+			case 'u': case 'U': return Direction::Up;
+			case 'd': case 'D': return Direction::Down;
+			case 'l': case 'L': return Direction::Left;
+			case 'r': case 'R': return Direction::Right;
+			default: return std::nullopt;
+		}
+	}
+
+	//The static part of a level: walls, goals and the precomputed tables search code needs.
+	//Cells outside the rows of the level are padded with walls, so every non-wall cell has four in-range neighbours.
+	class Board {
+	private:
+		using This = Board;
+
+		size_t width = 0;
+		size_t height = 0;
+
+		std::vector<std::uint8_t> walls;
+		std::vector<std::uint8_t> goal_flags;
+
+		//Non-wall cells of each padded row, bit c for column c. Empty if the rows do not fit a word.
+		std::vector<std::uint64_t> floor_rows;
+		//Padded row of each cell, so bitboard lookups need no division.
+		std::vector<std::uint16_t> rows_of_cells;
+
+		std::vector<Cell> goals;
+		std::vector<Cell> initial_boxes;
+		Cell initial_player = no_cell;
+
+		std::vector<std::uint64_t> box_keys;
+		std::vector<std::uint64_t> player_keys;
+
+		std::vector<std::uint8_t> dead_squares;
+		//Indexed by cell * goals.size() + goal index, so the distances of one box are contiguous.
+		std::vector<std::uint16_t> push_distances;
+		//The same for pushes from each initial box, indexed by cell * initial_boxes.size() + box index.
+		std::vector<std::uint16_t> pull_distances;
+
+		//Walls the player can never get past close the level; everything unreachable becomes wall.
+		void seal_unreachable_cells() {
+			auto reached = std::vector<std::uint8_t>(walls.size());
+			auto stack = std::vector<Cell>{initial_player};
+			reached[initial_player] = 1;
+			while (!stack.empty()) {
+				auto cell = stack.back();
+				stack.pop_back();
+				for (auto direction : all_directions) {
+					auto next = neighbor(cell, direction);
+					if (!walls[next] && !reached[next]) {
+						reached[next] = 1;
+						stack.push_back(next);
+					}
+				}
+			}
+
+			for (auto cell = size_t{}; cell < walls.size(); ++cell) {
+				if (!reached[cell]) {
+					walls[cell] = 1;
+				}
+			}
+		}
+
+		void compute_bitboards() {
+			rows_of_cells.resize(walls.size());
+			for (auto cell = size_t{}; cell < walls.size(); ++cell) {
+				rows_of_cells[cell] = static_cast<std::uint16_t>(cell / width);
+			}
+
+			floor_rows.clear();
+			if (width > max_bitboard_width) {
+				return;
+			}
+			floor_rows.assign(height, 0);
+			for (auto cell = size_t{}; cell < walls.size(); ++cell) {
+				if (!walls[cell]) {
+					floor_rows[cell / width] |= std::uint64_t{1} << (cell % width);
+				}
+			}
+		}
+
+		//Breadth-first pulls from every goal, walls being the only obstacles. A box can reach a goal
+		//from exactly the cells it can be pulled to from there, so the cells no goal reaches are dead.
+		void compute_push_distances() {
+			push_distances.assign(walls.size() * goals.size(), unreachable);
+			dead_squares.assign(walls.size(), 1);
+
+			auto queue = std::vector<Cell>{};
+			for (auto goal_index = size_t{}; goal_index < goals.size(); ++goal_index) {
+				auto distance_at = [&](Cell cell) -> auto & {
+					return push_distances[cell * goals.size() + goal_index];
+				};
+
+				queue.clear();
+				if (!walls[goals[goal_index]]) {
+					queue.push_back(goals[goal_index]);
+					distance_at(goals[goal_index]) = 0;
+				}
+
+				for (auto i = size_t{}; i < queue.size(); ++i) {
+					auto cell = queue[i];
+					dead_squares[cell] = 0;
+					for (auto direction : all_directions) {
+						auto box_to = neighbor(cell, direction);
+						if (walls[box_to] || distance_at(box_to) != unreachable) {
+							continue;
+						}
+						auto player_to = neighbor(box_to, direction);
+						if (walls[player_to]) {
+							continue;
+						}
+						distance_at(box_to) = static_cast<std::uint16_t>(distance_at(cell) + 1);
+						queue.push_back(box_to);
+					}
+				}
+			}
+		}
+
+		//Breadth-first pushes of a lone box from every initial box, the mirror image of compute_push_distances.
+		void compute_pull_distances() {
+			pull_distances.assign(walls.size() * initial_boxes.size(), unreachable);
+
+			auto queue = std::vector<Cell>{};
+			for (auto box_index = size_t{}; box_index < initial_boxes.size(); ++box_index) {
+				auto distance_at = [&](Cell cell) -> auto & {
+					return pull_distances[cell * initial_boxes.size() + box_index];
+				};
+
+				queue.clear();
+				if (!walls[initial_boxes[box_index]]) {
+					queue.push_back(initial_boxes[box_index]);
+					distance_at(initial_boxes[box_index]) = 0;
+				}
+
+				for (auto i = size_t{}; i < queue.size(); ++i) {
+					auto cell = queue[i];
+					for (auto direction : all_directions) {
+						auto box_to = neighbor(cell, direction);
+						if (walls[box_to] || distance_at(box_to) != unreachable) {
+							continue;
+						}
+						if (walls[neighbor(cell, opposite(direction))]) {
+							continue;
+						}
+						distance_at(box_to) = static_cast<std::uint16_t>(distance_at(cell) + 1);
+						queue.push_back(box_to);
+					}
+				}
+			}
+		}
+
+		void generate_zobrist_keys() {
+			//Fixed seed, so hashes are reproducible across runs and threads.
+			auto engine = std::mt19937_64{0x5'0c0b'a11ULL};
+			box_keys.resize(walls.size());
+			player_keys.resize(walls.size());
+			for (auto &key : box_keys) {
+				key = engine();
+			}
+			for (auto &key : player_keys) {
+				key = engine();
+			}
+		}
+
+	public:
+		static constexpr auto unreachable = std::numeric_limits<std::uint16_t>::max();
+		static constexpr auto max_bitboard_width = size_t{64};
+
+		Board() = default;
+
+		explicit Board(Level level) {
+			using namespace stdc::literals;
+
+			height = level.get_height() + 2;
+			width = level.get_width() + 2;
+
+			if (level.empty() || width * height > no_cell) {
+				throw std::invalid_argument{"Level is empty or too large for a Board."};
+			}
+
+			walls.assign(width * height, 1);
+			goal_flags.assign(width * height, 0);
+
+			for (auto r = 0_z; r < level.get_height(); ++r) {
+				for (auto c = 0_z; c < level.get_width(); ++c) {
+					auto piece = level.at(r, c);
+					auto cell = cell_at(r, c);
+
+					//World::move lets the player walk on anything that is not a wall or a box.
+					walls[cell] = piece == SokobanPiece::Wall;
+
+					switch (piece) {
+						case SokobanPiece::Player:
+						case SokobanPiece::PlayerAndGoal:
+							if (initial_player != no_cell) {
+								throw std::invalid_argument{"Level has more than one player."};
+							}
+							initial_player = cell;
+							break;
+						case SokobanPiece::Box:
+						case SokobanPiece::BoxAndGoal:
+							initial_boxes.push_back(cell);
+							break;
+						case SokobanPiece::Wall:
+						case SokobanPiece::Goal:
+						case SokobanPiece::Floor:
+						case SokobanPiece::Nothing:
+							break;
+					}
+
+					switch (piece) {
+						case SokobanPiece::PlayerAndGoal:
+						case SokobanPiece::BoxAndGoal:
+						case SokobanPiece::Goal:
+							goal_flags[cell] = 1;
+							goals.push_back(cell);
+							break;
+						case SokobanPiece::Wall:
+						case SokobanPiece::Player:
+						case SokobanPiece::Box:
+						case SokobanPiece::Floor:
+						case SokobanPiece::Nothing:
+							break;
+					}
+				}
+			}
+
+			if (initial_player == no_cell) {
+				throw std::invalid_argument{"Level has no player."};
+			}
+
+			if (initial_boxes.size() != goals.size() || goals.empty()) {
+				throw std::invalid_argument{"Level needs as many boxes as goals, and at least one."};
+			}
+
+			seal_unreachable_cells();
+			compute_bitboards();
+			compute_push_distances();
+			compute_pull_distances();
+			generate_zobrist_keys();
+		}
+
+		[[nodiscard]] auto get_width() const { return width; }
+		[[nodiscard]] auto get_height() const { return height; }
+		[[nodiscard]] auto number_of_cells() const { return walls.size(); }
+
+		[[nodiscard]] auto cell_at(size_t row, size_t column) const -> Cell {
+			assert(row + 1 < height && column + 1 < width);
+			return static_cast<Cell>((row + 1) * width + column + 1);
+		}
+
+		[[nodiscard]] auto row_of(Cell cell) const -> size_t { return cell / width - 1; }
+		[[nodiscard]] auto column_of(Cell cell) const -> size_t { return cell % width - 1; }
+
+		[[nodiscard]] auto offset(Direction direction) const -> ptrdiff_t {
+			switch (direction) {
+				case Direction::Up: return -static_cast<ptrdiff_t>(width);
+				case Direction::Down: return static_cast<ptrdiff_t>(width);
+				case Direction::Left: return -1;
+				case Direction::Right: return 1;
+			}
+			assert(false);
+			return 0;
+		}
+
+		[[nodiscard]] auto neighbor(Cell cell, Direction direction) const -> Cell {
+			assert(!walls[cell]);
+			return static_cast<Cell>(cell + offset(direction));
+		}
+
+		[[nodiscard]] auto is_wall(Cell cell) const -> bool { return walls[cell]; }
+
+		//Bitboards hold one padded row per word, which levels up to max_bitboard_width - 2 columns wide allow.
+		[[nodiscard]] auto has_bitboards() const -> bool { return !floor_rows.empty(); }
+		[[nodiscard]] auto get_floor_rows() const -> const auto & { return floor_rows; }
+		[[nodiscard]] auto bitboard_row(Cell cell) const -> size_t { return rows_of_cells[cell]; }
+
+		[[nodiscard]] auto bitboard_mask(Cell cell) const -> std::uint64_t {
+			return std::uint64_t{1} << (cell - bitboard_row(cell) * width);
+		}
+		[[nodiscard]] auto is_goal(Cell cell) const -> bool { return goal_flags[cell]; }
+
+		//Non-wall cells from which no push sequence brings a box onto any goal.
+		[[nodiscard]] auto is_dead_square(Cell cell) const -> bool { return !walls[cell] && dead_squares[cell]; }
+
+		//Pushes needed to bring a box from the cell onto the goal if it were the only box, or `unreachable`.
+		[[nodiscard]] auto push_distance(Cell cell, size_t goal_index) const -> std::uint16_t {
+			return push_distances[cell * goals.size() + goal_index];
+		}
+
+		[[nodiscard]] auto get_push_distances(Cell cell) const -> const std::uint16_t * {
+			return push_distances.data() + cell * goals.size();
+		}
+
+		//Pulls needed to bring a box from the cell back onto the initial box if it were the only box, or `unreachable`.
+		[[nodiscard]] auto pull_distance(Cell cell, size_t box_index) const -> std::uint16_t {
+			return pull_distances[cell * initial_boxes.size() + box_index];
+		}
+
+		[[nodiscard]] auto get_goals() const -> const auto & { return goals; }
+		[[nodiscard]] auto get_initial_boxes() const -> const auto & { return initial_boxes; }
+		[[nodiscard]] auto get_initial_player() const { return initial_player; }
+
+		[[nodiscard]] auto box_key(Cell cell) const { return box_keys[cell]; }
+		[[nodiscard]] auto player_key(Cell cell) const { return player_keys[cell]; }
+
+		[[nodiscard]] auto hash_boxes(const std::vector<Cell> &boxes) const {
+			auto hash = std::uint64_t{};
+			for (auto box : boxes) {
+				hash ^= box_keys[box];
+			}
+			return hash;
+		}
+
+	}; //Board
+
+} //namespace sstm
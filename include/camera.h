@@ -54,7 +54,6 @@ public:
 
 	[[nodiscard]] glm::mat4 GetViewMatrix(const glm::vec3 &lCenter, float deltaTime) /*const*/ {
 		auto lFront = glm::vec3{0.f, -1.f, 0.f}; 
-		auto lUp = glm::vec3{1.f, 0.f, 0.f}; 
 		auto lFront_to_center = lCenter - Position;
 
 		auto coolFront = lFront + .01f * lFront_to_center;
@@ -63,6 +62,12 @@ public:
 		auto velocity = MovementSpeed * deltaTime;
 		actualFront += diff * velocity * .1f;
 
+		return GetCurrentViewMatrix();
+	}
+
+	// The view matrix of the last frame, without moving the camera any further
+	[[nodiscard]] glm::mat4 GetCurrentViewMatrix() const {
+		auto lUp = glm::vec3{1.f, 0.f, 0.f}; 
 		return glm::lookAt(Position, Position + actualFront, lUp);
 	}
 
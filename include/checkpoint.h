@@ -0,0 +1,116 @@
+#pragma once
+
+#include "board.h"
+
+#include <cool/filesystem.h>
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace sstm {
+
+	//Checkpoints are raw fields in native byte order behind a magic number and a format version, in the layout of
+	//the machine that wrote them, like the pattern database.
+	inline constexpr auto checkpoint_magic = std::uint64_t{0x3154'504b'4354'5353}; //"SSTCKPT1"
+	inline constexpr auto checkpoint_version = std::uint32_t{3};
+
+	//Identifies the level a checkpoint belongs to. Zobrist keys have a fixed seed, so this is stable across runs.
+	[[nodiscard]] inline auto fingerprint(const Board &board) -> std::uint64_t {
+		auto hash = std::uint64_t{board.get_width()} * 0x9e37'79b9'7f4a'7c15u;
+		for (auto cell = Cell{}; cell < board.number_of_cells(); ++cell) {
+			if (board.is_wall(cell)) {
+				hash ^= board.box_key(cell) * 3;
+			} else if (board.is_goal(cell)) {
+				hash ^= board.box_key(cell) * 5;
+			}
+		}
+		return hash ^ board.hash_boxes(board.get_initial_boxes()) ^ board.player_key(board.get_initial_player());
+	}
+
+	//Writes next to `path` and only replaces it on commit, so a job killed while writing keeps its last checkpoint.
+	class CheckpointWriter {
+	private:
+		stdc::fs::path path;
+		stdc::fs::path temporary_path;
+		std::ofstream os;
+
+	public:
+		explicit CheckpointWriter(stdc::fs::path _path) :
+			path{std::move(_path)},
+			temporary_path{path.string() + ".tmp"},
+			os{temporary_path, std::ios::binary | std::ios::trunc}
+		{
+			if (!os) {
+				throw std::runtime_error{"Cannot write " + temporary_path.string() + "."};
+			}
+			write(checkpoint_magic);
+			write(checkpoint_version);
+		}
+
+		template<typename T>
+		void write(const T &value) {
+			static_assert(std::is_trivially_copyable_v<T>);
+			os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+
+		template<typename T>
+		void write(const std::vector<T> &values) {
+			static_assert(std::is_trivially_copyable_v<T>);
+			os.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+		}
+
+		void commit() {
+			os.close();
+			if (!os) {
+				throw std::runtime_error{"Cannot write " + temporary_path.string() + "."};
+			}
+			stdc::fs::rename(temporary_path, path);
+		}
+	};
+
+	class CheckpointReader {
+	private:
+		std::ifstream is;
+
+		void check() const {
+			if (!is) {
+				throw std::runtime_error{"Truncated checkpoint."};
+			}
+		}
+
+	public:
+		explicit CheckpointReader(const stdc::fs::path &path) :
+			is{path, std::ios::binary}
+		{
+			if (!is) {
+				throw std::runtime_error{"Cannot read " + path.string() + "."};
+			}
+			if (read<std::uint64_t>() != checkpoint_magic || read<std::uint32_t>() != checkpoint_version) {
+				throw std::runtime_error{path.string() + " is not a checkpoint of this version."};
+			}
+		}
+
+		template<typename T>
+		[[nodiscard]] auto read() -> T {
+			static_assert(std::is_trivially_copyable_v<T>);
+			auto value = T{};
+			is.read(reinterpret_cast<char *>(&value), sizeof(value));
+			check();
+			return value;
+		}
+
+		template<typename T>
+		[[nodiscard]] auto read(size_t size) -> std::vector<T> {
+			static_assert(std::is_trivially_copyable_v<T>);
+			auto values = std::vector<T>(size);
+			is.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(size * sizeof(T)));
+			check();
+			return values;
+		}
+	};
+
+} //namespace sstm
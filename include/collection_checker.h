@@ -0,0 +1,208 @@
+#pragma once
+
+#include "result_cache.h"
+#include "sokoban_parser.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	struct LevelCheck {
+		size_t number_of_players = 0;
+		size_t number_of_boxes = 0;
+		size_t number_of_goals = 0;
+		//The player cannot walk off the level, even with every box out of the way.
+		bool is_closed = false;
+		//Only well-formed levels are solved.
+		std::optional<SolverResult> maybe_result;
+		//The result was found in the result cache rather than solved.
+		bool is_cached = false;
+		//A solution is push-optimal, as the search that found it promised.
+		bool is_optimal = false;
+		//A proof comes from a search that saw every position.
+		bool is_complete = false;
+		//Why the level was not solved, if it was well-formed but the solver threw anyway.
+		std::string error;
+
+		[[nodiscard]] auto is_well_formed() const -> bool {
+			return number_of_players == 1 && number_of_boxes == number_of_goals && number_of_goals > 0 && is_closed;
+		}
+
+		[[nodiscard]] auto status() const -> std::string_view {
+			if (!error.empty()) {
+				return "error";
+			}
+			if (!maybe_result) {
+				return "malformed";
+			}
+			return maybe_result->solution ? "solved" : maybe_result->proven_unsolvable ? "unsolvable" : "gave up";
+		}
+	};
+
+	//Floods the level from its first player over everything but walls. Reaching a Nothing cell or leaving the
+	//rows means the walls have a gap.
+	[[nodiscard]] inline auto is_closed(Level level) -> bool {
+		auto maybe_start = std::optional<std::pair<size_t, size_t>>{};
+		for (auto r = size_t{}; r < level.get_height() && !maybe_start; ++r) {
+			for (auto c = size_t{}; c < level.get_width(); ++c) {
+				if (level.at(r, c) == SokobanPiece::Player || level.at(r, c) == SokobanPiece::PlayerAndGoal) {
+					maybe_start = std::pair{r, c};
+					break;
+				}
+			}
+		}
+		if (!maybe_start) {
+			return false;
+		}
+
+		auto visited = std::vector<std::uint8_t>(level.get_height() * level.get_width());
+		auto stack = std::vector{*maybe_start};
+		visited[maybe_start->first * level.get_width() + maybe_start->second] = 1;
+		while (!stack.empty()) {
+			auto [r, c] = stack.back();
+			stack.pop_back();
+			if (level.at(r, c) == SokobanPiece::Nothing) {
+				return false;
+			}
+
+			auto neighbors = std::array{std::pair{r - 1, c}, std::pair{r + 1, c}, std::pair{r, c - 1}, std::pair{r, c + 1}};
+			for (auto [nr, nc] : neighbors) {
+				//Unsigned wrap-around turns row and column -1 into out of bounds as well.
+				if (nr >= level.get_height() || nc >= level.get_width()) {
+					return false;
+				}
+				if (level.at(nr, nc) != SokobanPiece::Wall && !visited[nr * level.get_width() + nc]) {
+					visited[nr * level.get_width() + nc] = 1;
+					stack.emplace_back(nr, nc);
+				}
+			}
+		}
+		return true;
+	}
+
+	[[nodiscard]] inline auto check_level(Level level, SolverOptions options, const ResultCache *result_cache = nullptr) -> LevelCheck {
+		auto check = LevelCheck{};
+		for (auto r = size_t{}; r < level.get_height(); ++r) {
+			for (auto c = size_t{}; c < level.get_width(); ++c) {
+				auto piece = level.at(r, c);
+				check.number_of_players += piece == SokobanPiece::Player || piece == SokobanPiece::PlayerAndGoal;
+				check.number_of_boxes += piece == SokobanPiece::Box || piece == SokobanPiece::BoxAndGoal;
+				check.number_of_goals += piece == SokobanPiece::Goal || piece == SokobanPiece::PlayerAndGoal || piece == SokobanPiece::BoxAndGoal;
+			}
+		}
+		check.is_closed = is_closed(level);
+
+		if (check.is_well_formed()) {
+			try {
+				if (result_cache) {
+					check.maybe_result = result_cache->find(level, options.is_push_optimal());
+					check.is_cached = check.maybe_result.has_value();
+				}
+				if (!check.maybe_result) {
+					check.maybe_result = solve(level, options);
+				}
+				check.is_optimal = options.is_push_optimal();
+				check.is_complete = options.can_prove_unsolvable();
+			} catch (std::exception &e) {
+				check.error = e.what();
+			}
+		}
+		return check;
+	}
+
+	struct CheckerOptions {
+		std::chrono::milliseconds time_limit{1000};
+		//0 uses every hardware thread.
+		size_t number_of_threads = 0;
+		//Overrides maybe_time_limit with time_limit.
+		SolverOptions solver_options;
+		//Looked up before a level is solved, if set.
+		const ResultCache *result_cache = nullptr;
+	};
+
+	//Checks the levels on a pool of threads, each taking the next unchecked level, so a few hard levels do not
+	//hold up the rest. Each level is solved sequentially within the time limit.
+	[[nodiscard]] inline auto check_collection(const LevelStore &levels, CheckerOptions options) -> std::vector<LevelCheck> {
+		auto checks = std::vector<LevelCheck>(levels.size());
+		auto next_level = std::atomic<size_t>{0};
+
+		auto solver_options = options.solver_options;
+		solver_options.maybe_time_limit = options.time_limit;
+
+		auto number_of_threads = options.number_of_threads ? options.number_of_threads : size_t{std::thread::hardware_concurrency()};
+		{
+			auto threads = std::vector<std::jthread>{};
+			for (auto i = size_t{}; i < std::max(number_of_threads, size_t{1}); ++i) {
+				threads.emplace_back([&]() {
+					for (auto level_id = next_level++; level_id < levels.size(); level_id = next_level++) {
+						checks[level_id] = check_level(levels[level_id], solver_options, options.result_cache);
+					}
+				});
+			}
+		}
+		return checks;
+	}
+
+	//Quoted, with quotes, backslashes and control characters escaped.
+	inline void write_json_string(std::string_view text, std::ostream &os) {
+		os << '"';
+		for (auto c : text) {
+			auto byte = static_cast<unsigned char>(c);
+			if (c == '"' || c == '\\') {
+				os << '\\' << c;
+			} else if (byte < 0x20) {
+				auto digits = std::string_view{"0123456789abcdef"};
+				os << "\\u00" << digits[byte >> 4] << digits[byte & 0xf];
+			} else {
+				os << c;
+			}
+		}
+		os << '"';
+	}
+
+	//One JSON object per line and level, in collection order.
+	inline void write_check_report(const std::vector<LevelCheck> &checks, std::ostream &os) {
+		for (auto level_id = size_t{}; level_id < checks.size(); ++level_id) {
+			const auto &check = checks[level_id];
+			os << "{\"level\": " << level_id
+				<< ", \"players\": " << check.number_of_players
+				<< ", \"boxes\": " << check.number_of_boxes
+				<< ", \"goals\": " << check.number_of_goals
+				<< ", \"closed\": " << (check.is_closed ? "true" : "false")
+				<< ", \"status\": \"" << check.status() << '"'
+				<< ", \"cached\": " << (check.is_cached ? "true" : "false");
+			if (check.maybe_result) {
+				const auto &result = *check.maybe_result;
+				if (result.solution) {
+					os << ", \"pushes\": " << std::count_if(RANGE(*result.solution), [](char c) { return 'A' <= c && c <= 'Z'; })
+						<< ", \"moves\": " << result.solution->size()
+						<< ", \"solution\": \"" << *result.solution << '"';
+				}
+				os << ", \"expanded_nodes\": " << result.statistics.expanded_nodes
+					<< ", \"seconds\": " << std::fixed << std::setprecision(3) << result.statistics.seconds << std::defaultfloat;
+			}
+			if (!check.error.empty()) {
+				os << ", \"error\": ";
+				write_json_string(check.error, os);
+			}
+			os << "}\n";
+		}
+	}
+
+} //namespace sstm
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+#include "reachability.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace sstm {
+
+	//Finds PI-corrals: regions the player cannot reach whose fence boxes can only be pushed inward (I),
+	//with every such push available right now (P). If an unfinished PI-corral exists, some solution
+	//continues with one of its inward pushes, so search only has to expand those.
+	//Works from the Reachability already computed for state normalization, no extra player flood fills.
+	class CorralAnalysis {
+	private:
+		static constexpr auto no_area = std::numeric_limits<std::uint32_t>::max();
+
+		struct Corral {
+			bool is_pi = true;
+			bool is_unfinished = false;
+			size_t number_of_pushes = 0;
+		};
+
+		std::vector<std::uint32_t> area_of;
+		std::vector<Cell> labelled;
+		std::vector<Cell> stack;
+		std::vector<std::uint32_t> parents;
+		std::vector<Corral> corrals;
+		std::vector<std::uint32_t> corral_of_box;
+		std::vector<Push> pushes;
+
+		[[nodiscard]] auto find(std::uint32_t area) -> std::uint32_t {
+			while (parents[area] != area) {
+				parents[area] = parents[parents[area]];
+				area = parents[area];
+			}
+			return area;
+		}
+
+		void label_areas(const Board &board, const Position &position, const Reachability &reachability) {
+			for (auto cell : labelled) {
+				area_of[cell] = no_area;
+			}
+			labelled.clear();
+			parents.clear();
+
+			if (area_of.size() != board.number_of_cells()) {
+				area_of.assign(board.number_of_cells(), no_area);
+			}
+
+			auto is_corral_floor = [&](Cell cell) {
+				return area_of[cell] == no_area && position.is_free(cell) && !reachability.contains(cell);
+			};
+
+			for (auto box : position.get_boxes()) {
+				for (auto direction : all_directions) {
+					auto start = board.neighbor(box, direction);
+					if (!is_corral_floor(start)) {
+						continue;
+					}
+
+					auto area = static_cast<std::uint32_t>(parents.size());
+					parents.push_back(area);
+					area_of[start] = area;
+					labelled.push_back(start);
+					stack.push_back(start);
+					while (!stack.empty()) {
+						auto cell = stack.back();
+						stack.pop_back();
+						for (auto next_direction : all_directions) {
+							auto next = board.neighbor(cell, next_direction);
+							if (is_corral_floor(next)) {
+								area_of[next] = area;
+								labelled.push_back(next);
+								stack.push_back(next);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		[[nodiscard]] auto corral_at(Cell cell) -> std::uint32_t {
+			return area_of[cell] == no_area ? no_area : find(area_of[cell]);
+		}
+
+	public:
+		//Returns true if an unfinished PI-corral was found; get_pushes() then holds its inward pushes.
+		//An empty push list means the corral can never be opened, so the position is a deadlock.
+		[[nodiscard]] auto analyse(const Board &board, const Position &position, const Reachability &reachability) -> bool {
+			label_areas(board, position, reachability);
+			if (parents.empty()) {
+				return false;
+			}
+
+			const auto &boxes = position.get_boxes();
+
+			//Areas touching the same box form one corral.
+			for (auto box : boxes) {
+				auto first = no_area;
+				for (auto direction : all_directions) {
+					auto area = corral_at(board.neighbor(box, direction));
+					if (area == no_area) {
+						continue;
+					}
+					if (first == no_area) {
+						first = area;
+					} else if (area != first) {
+						parents[area] = first;
+					}
+				}
+			}
+
+			corrals.assign(parents.size(), Corral{});
+			for (auto cell : labelled) {
+				if (board.is_goal(cell)) {
+					corrals[find(area_of[cell])].is_unfinished = true;
+				}
+			}
+
+			corral_of_box.assign(boxes.size(), no_area);
+			for (auto i = size_t{}; i < boxes.size(); ++i) {
+				auto box = boxes[i];
+				auto corral = no_area;
+				auto is_fence = false;
+				for (auto direction : all_directions) {
+					auto neighbor = board.neighbor(box, direction);
+					if (auto area = corral_at(neighbor); area != no_area) {
+						corral = area;
+					}
+					is_fence = is_fence || reachability.contains(neighbor);
+				}
+				if (corral == no_area) {
+					continue;
+				}
+				corral_of_box[i] = corral;
+
+				auto &info = corrals[corral];
+				info.is_unfinished = info.is_unfinished || !board.is_goal(box);
+				if (!is_fence) {
+					continue;
+				}
+
+				for (auto direction : all_directions) {
+					auto target = board.neighbor(box, direction);
+					if (!position.is_free(target) || board.is_dead_square(target)) {
+						continue;
+					}
+					auto stand = board.neighbor(box, opposite(direction));
+					auto is_player_outside = reachability.contains(stand);
+
+					if (corral_at(target) == corral) {
+						if (is_player_outside) {
+							++info.number_of_pushes;
+						} else if (!board.is_wall(stand) && corral_at(stand) != corral) {
+							info.is_pi = false;
+						}
+					} else if (is_player_outside) {
+						info.is_pi = false;
+					}
+				}
+			}
+
+			auto best = no_area;
+			for (auto corral = std::uint32_t{}; corral < corrals.size(); ++corral) {
+				const auto &info = corrals[corral];
+				if (find(corral) != corral || !info.is_pi || !info.is_unfinished) {
+					continue;
+				}
+				if (best == no_area || info.number_of_pushes < corrals[best].number_of_pushes) {
+					best = corral;
+				}
+			}
+
+			if (best == no_area) {
+				return false;
+			}
+
+			pushes.clear();
+			for (auto i = size_t{}; i < boxes.size(); ++i) {
+				if (corral_of_box[i] != best) {
+					continue;
+				}
+				auto box = boxes[i];
+				for (auto direction : all_directions) {
+					auto target = board.neighbor(box, direction);
+					if (position.is_free(target) && !board.is_dead_square(target) && corral_at(target) == best &&
+						reachability.contains(board.neighbor(box, opposite(direction)))) {
+						pushes.push_back(Push{box, direction});
+					}
+				}
+			}
+			return true;
+		}
+
+		[[nodiscard]] auto get_pushes() const -> const auto & { return pushes; }
+	};
+
+} //namespace sstm
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "board.h"
+
+#include <array>
+#include <cstdint>
+
+namespace sstm {
+
+	//Freeze deadlock check around one box, usually the one just pushed.
+	//A box is frozen if it can move along neither axis. It cannot move along an axis if a wall is on one side,
+	//if both sides are dead squares, or if a box on one side is frozen itself. While a box is examined it counts
+	//as a wall, which resolves the 2x2 and diagonal clusters without revisiting boxes.
+	//Only boxes touching the cluster are visited, so for typical positions this is a handful of lookups.
+	template<typename IsBox>
+	class FreezeCheck {
+	private:
+		struct Verdict {
+			bool frozen;
+			bool off_goal;
+		};
+
+		static constexpr auto max_cluster_size = size_t{32};
+
+		const Board &board;
+		const IsBox &is_box;
+
+		std::array<Cell, max_cluster_size> examined{};
+		size_t number_examined = 0;
+
+		[[nodiscard]] auto is_examined(Cell cell) const -> bool {
+			for (auto i = size_t{}; i < number_examined; ++i) {
+				if (examined[i] == cell) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		[[nodiscard]] auto is_blocked_on_axis(Cell box, Direction one_side, Direction other_side) -> Verdict {
+			auto first = board.neighbor(box, one_side);
+			auto second = board.neighbor(box, other_side);
+
+			if (board.is_wall(first) || board.is_wall(second) || is_examined(first) || is_examined(second)) {
+				return {true, false};
+			}
+
+			if (board.is_dead_square(first) && board.is_dead_square(second)) {
+				return {true, false};
+			}
+
+			for (auto side : {first, second}) {
+				if (is_box(side)) {
+					if (auto verdict = is_frozen(side); verdict.frozen) {
+						return verdict;
+					}
+				}
+			}
+
+			return {false, false};
+		}
+
+		[[nodiscard]] auto is_frozen(Cell box) -> Verdict {
+			//Giving up on huge clusters only ever misses deadlocks, it never invents one.
+			if (number_examined == max_cluster_size) {
+				return {false, false};
+			}
+
+			examined[number_examined] = box;
+			++number_examined;
+
+			auto verdict = Verdict{false, false};
+			if (auto horizontal = is_blocked_on_axis(box, Direction::Left, Direction::Right); horizontal.frozen) {
+				if (auto vertical = is_blocked_on_axis(box, Direction::Up, Direction::Down); vertical.frozen) {
+					verdict = Verdict{true, !board.is_goal(box) || horizontal.off_goal || vertical.off_goal};
+				}
+			}
+
+			--number_examined;
+			return verdict;
+		}
+
+	public:
+		FreezeCheck(const Board &_board, const IsBox &_is_box) :
+			board{_board},
+			is_box{_is_box}
+		{}
+
+		//True iff the box is part of a frozen cluster with at least one box off its goal.
+		[[nodiscard]] auto is_deadlock(Cell box) -> bool {
+			auto verdict = is_frozen(box);
+			return verdict.frozen && verdict.off_goal;
+		}
+	};
+
+	//is_box(cell) tells whether a box occupies the cell, including the box at `box` itself.
+	template<typename IsBox>
+	[[nodiscard]] auto is_freeze_deadlock(const Board &board, Cell box, const IsBox &is_box) -> bool {
+		return FreezeCheck<IsBox>{board, is_box}.is_deadlock(box);
+	}
+
+	//A box on a dead square or in a frozen cluster off its goals can never be solved from here.
+	template<typename IsBox>
+	[[nodiscard]] auto is_deadlocked_box(const Board &board, Cell box, const IsBox &is_box) -> bool {
+		return board.is_dead_square(box) || is_freeze_deadlock(board, box, is_box);
+	}
+
+} //namespace sstm
@@ -0,0 +1,381 @@
+#pragma once
+
+#include "board.h"
+
+#include <cool/algorithm.h>
+#include <cool/filesystem.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//The 5x5 window around a box, two bits a cell in row-major order. Boxes on goals count as goals, see
+	//PatternDatabase. Only relative positions matter, so a pattern means the same in every level.
+	class PatternWindow {
+	public:
+		enum class Content : std::uint8_t {Floor, Wall, Box, Goal};
+
+		static constexpr auto size = 5;
+		static constexpr auto number_of_cells = size * size;
+
+	private:
+		using Permutation = std::array<std::uint8_t, number_of_cells>;
+
+		//The eight rotations and reflections, as the window cell each cell of the transformed window comes from.
+		static constexpr auto symmetries = []() {
+			auto result = std::array<Permutation, 8>{};
+			for (auto s = 0; s < 8; ++s) {
+				for (auto r = 0; r < size; ++r) {
+					for (auto c = 0; c < size; ++c) {
+						auto [from_r, from_c] = std::pair{s & 1 ? c : r, s & 1 ? r : c};
+						from_r = s & 2 ? size - 1 - from_r : from_r;
+						from_c = s & 4 ? size - 1 - from_c : from_c;
+						result[static_cast<size_t>(s)][static_cast<size_t>(r * size + c)] = static_cast<std::uint8_t>(from_r * size + from_c);
+					}
+				}
+			}
+			return result;
+		}();
+
+		std::array<Content, number_of_cells> cells{};
+
+	public:
+		//Everything beyond the board is wall. is_box(cell) tells whether a box occupies the cell.
+		template<typename IsBox>
+		PatternWindow(const Board &board, Cell center, const IsBox &is_box) {
+			auto center_row = static_cast<ptrdiff_t>(center / board.get_width());
+			auto center_column = static_cast<ptrdiff_t>(center % board.get_width());
+			for (auto r = 0; r < size; ++r) {
+				for (auto c = 0; c < size; ++c) {
+					auto row = center_row + r - size / 2;
+					auto column = center_column + c - size / 2;
+					auto &content = cells[static_cast<size_t>(r * size + c)];
+					if (row < 0 || column < 0 || row >= static_cast<ptrdiff_t>(board.get_height()) || column >= static_cast<ptrdiff_t>(board.get_width())) {
+						content = Content::Wall;
+						continue;
+					}
+					auto cell = static_cast<Cell>(static_cast<size_t>(row) * board.get_width() + static_cast<size_t>(column));
+					if (board.is_wall(cell)) {
+						content = Content::Wall;
+					} else if (board.is_goal(cell)) {
+						content = Content::Goal;
+					} else {
+						content = is_box(cell) ? Content::Box : Content::Floor;
+					}
+				}
+			}
+		}
+
+		explicit PatternWindow(std::uint64_t key) {
+			for (auto &content : cells) {
+				content = static_cast<Content>(key & 3);
+				key >>= 2;
+			}
+		}
+
+		[[nodiscard]] auto at(size_t index) const { return cells[index]; }
+
+		[[nodiscard]] auto number_of_boxes() const -> size_t {
+			return static_cast<size_t>(std::count(RANGE(cells), Content::Box));
+		}
+
+		[[nodiscard]] auto key() const -> std::uint64_t {
+			auto key = std::uint64_t{};
+			for (auto i = number_of_cells; i-- > 0;) {
+				key = key << 2 | static_cast<std::uint64_t>(cells[static_cast<size_t>(i)]);
+			}
+			return key;
+		}
+
+		//The keys of the window turned every way, the unturned one first.
+		[[nodiscard]] auto symmetric_keys() const -> std::array<std::uint64_t, 8> {
+			auto keys = std::array<std::uint64_t, 8>{};
+			for (auto s = size_t{}; s < symmetries.size(); ++s) {
+				for (auto i = number_of_cells; i-- > 0;) {
+					keys[s] = keys[s] << 2 | static_cast<std::uint64_t>(cells[symmetries[s][static_cast<size_t>(i)]]);
+				}
+			}
+			return keys;
+		}
+
+		//The smallest key over all symmetries, so a pattern is stored once however it is turned.
+		[[nodiscard]] auto canonical_key() const -> std::uint64_t {
+			return std::ranges::min(symmetric_keys());
+		}
+	};
+
+	//Decides whether the boxes of a window can never all be solved. The question is relaxed until it no longer
+	//depends on the level: every cell outside the window is free floor, and a box is taken off the board once
+	//it reaches a goal or leaves the window. The player may start anywhere. Each relaxation only adds moves, so
+	//if not even this lets every box go, no position containing the window can be solved.
+	class PatternAnalysis {
+	private:
+		static constexpr auto size = PatternWindow::size;
+		static constexpr auto window_mask = (std::uint32_t{1} << PatternWindow::number_of_cells) - 1;
+		//One more bit for the player being outside the window.
+		static constexpr auto outside = std::uint32_t{1} << PatternWindow::number_of_cells;
+		static constexpr auto max_states = size_t{1} << 12;
+
+		static constexpr auto column_mask = [](int column) {
+			auto mask = std::uint32_t{};
+			for (auto r = 0; r < size; ++r) {
+				mask |= std::uint32_t{1} << (r * size + column);
+			}
+			return mask;
+		};
+		static constexpr auto first_column = column_mask(0);
+		static constexpr auto last_column = column_mask(size - 1);
+		static constexpr auto border = first_column | last_column | ((std::uint32_t{1} << size) - 1) | (((std::uint32_t{1} << size) - 1) << (size * (size - 1)));
+
+		std::uint32_t walls = 0;
+		std::uint32_t goals = 0;
+
+		[[nodiscard]] auto reachable_from(std::uint32_t seed, std::uint32_t boxes) const -> std::uint32_t {
+			auto free = ~walls & ~boxes & window_mask;
+			auto reach = seed;
+			while (true) {
+				auto next = reach & window_mask;
+				next |= (next & ~last_column) << 1 | (next & ~first_column) >> 1 | next << size | next >> size;
+				if (reach & outside) {
+					next |= border;
+				}
+				next &= free;
+				next |= reach & outside;
+				if (next & border) {
+					next |= outside;
+				}
+				next |= reach;
+				if (next == reach) {
+					return reach;
+				}
+				reach = next;
+			}
+		}
+
+	public:
+		//Giving up after max_states only ever hides a deadlock.
+		[[nodiscard]] auto is_dead(const PatternWindow &window) -> bool {
+			walls = 0;
+			goals = 0;
+			auto boxes = std::uint32_t{};
+			for (auto i = size_t{}; i < PatternWindow::number_of_cells; ++i) {
+				auto bit = std::uint32_t{1} << i;
+				switch (window.at(i)) {
+					case PatternWindow::Content::Wall: walls |= bit; break;
+					case PatternWindow::Content::Goal: goals |= bit; break;
+					case PatternWindow::Content::Box: boxes |= bit; break;
+					case PatternWindow::Content::Floor: break;
+				}
+			}
+
+			//Open addressing, a state is never 0 as the player always reaches something.
+			auto visited = std::vector<std::uint64_t>(2 * max_states);
+			auto number_visited = size_t{};
+			auto stack = std::vector<std::pair<std::uint32_t, std::uint32_t>>{};
+			auto visit = [&](std::uint32_t state_boxes, std::uint32_t reach) {
+				auto state = std::uint64_t{state_boxes} << 32 | reach;
+				auto slot = (state * 0x9e3779b97f4a7c15) >> (64 - std::countr_zero(visited.size()));
+				while (visited[slot] && visited[slot] != state) {
+					slot = (slot + 1) % visited.size();
+				}
+				if (!visited[slot]) {
+					visited[slot] = state;
+					++number_visited;
+					stack.emplace_back(state_boxes, reach);
+				}
+			};
+
+			//Every region the player could start in, the outside included.
+			auto covered = std::uint32_t{};
+			for (auto seed = outside; seed;) {
+				auto reach = reachable_from(seed, boxes);
+				covered |= reach;
+				visit(boxes, reach);
+				auto uncovered = ~covered & ~walls & ~boxes & window_mask;
+				seed = uncovered & (~uncovered + 1);
+			}
+
+			while (!stack.empty()) {
+				auto [state_boxes, reach] = stack.back();
+				stack.pop_back();
+				if (!state_boxes) {
+					return false;
+				}
+				if (number_visited > max_states) {
+					return false;
+				}
+
+				//Taking a box off only frees the player and the other boxes, so once one can go, no other push
+				//from here needs trying.
+				auto maybe_release = std::optional<std::pair<std::uint32_t, std::uint32_t>>{};
+				for (auto remaining = state_boxes; remaining && !maybe_release; remaining &= remaining - 1) {
+					auto box = std::countr_zero(remaining);
+					auto row = box / size;
+					auto column = box % size;
+					//Row and column steps, and whether the neighbour in that direction lies outside the window.
+					auto steps = std::array{
+						std::tuple{-size, row == 0, row == size - 1},
+						std::tuple{size, row == size - 1, row == 0},
+						std::tuple{-1, column == 0, column == size - 1},
+						std::tuple{1, column == size - 1, column == 0}
+					};
+					for (auto [step, is_target_outside, is_stand_outside] : steps) {
+						auto can_stand = is_stand_outside ? (reach & outside) != 0 : (reach >> (box - step) & 1) != 0;
+						if (!can_stand) {
+							continue;
+						}
+						auto next_boxes = state_boxes & ~(std::uint32_t{1} << box);
+						if (!is_target_outside) {
+							auto target = std::uint32_t{1} << (box + step);
+							if ((walls | state_boxes) & target) {
+								continue;
+							}
+							if (!(goals & target)) {
+								next_boxes |= target;
+							}
+						}
+						auto next_reach = reachable_from(std::uint32_t{1} << box, next_boxes);
+						if (std::popcount(next_boxes) < std::popcount(state_boxes)) {
+							maybe_release = std::pair{next_boxes, next_reach};
+							break;
+						}
+						visit(next_boxes, next_reach);
+					}
+				}
+				if (maybe_release) {
+					visit(maybe_release->first, maybe_release->second);
+				}
+			}
+			return true;
+		}
+	};
+
+	//Verdicts of PatternAnalysis. The dead windows are kept in a file, so every run and level profits from the
+	//deadlocks proven before; the file holds a magic number and a format version in native byte order, then the
+	//canonical key of each dead window. Windows that are not dead are only cached in memory, and dropped when
+	//there are too many. In memory every turned key is there, so a lookup is one hash of the window as it is.
+	//Safe to share between threads.
+	class PatternDatabase {
+	private:
+		using This = PatternDatabase;
+
+		static constexpr auto max_cached_patterns = size_t{1} << 22;
+		static constexpr auto magic = std::uint64_t{0x3154'4150'4453'5353}; //"SSSDPAT1"
+		static constexpr auto version = std::uint32_t{1};
+
+		std::optional<stdc::fs::path> maybe_path;
+		//The file is missing or of another format, so the next save starts it over.
+		bool is_file_stale = true;
+
+		//Looking a window up analyses it on first sight, which only caches what follows from the window anyway.
+		mutable std::shared_mutex mutex;
+		//Whether each analysed window is dead.
+		mutable std::unordered_map<std::uint64_t, bool> patterns;
+		//Canonical keys of the dead windows found since the last save.
+		mutable std::vector<std::uint64_t> unsaved;
+
+		//Returns whether the window was new.
+		auto insert(const PatternWindow &window, bool is_dead) const -> bool {
+			auto is_new = false;
+			for (auto key : window.symmetric_keys()) {
+				is_new |= patterns.emplace(key, is_dead).second;
+			}
+			return is_new;
+		}
+
+	public:
+		//Without a path, nothing outlives the database.
+		PatternDatabase() = default;
+
+		explicit PatternDatabase(stdc::fs::path path) :
+			maybe_path{std::move(path)}
+		{
+			auto is = std::ifstream{*maybe_path, std::ios::binary};
+			auto file_magic = std::uint64_t{};
+			auto file_version = std::uint32_t{};
+			is.read(reinterpret_cast<char *>(&file_magic), sizeof(file_magic));
+			is.read(reinterpret_cast<char *>(&file_version), sizeof(file_version));
+			if (!is || file_magic != magic || file_version != version) {
+				return;
+			}
+			is_file_stale = false;
+			auto key = std::uint64_t{};
+			while (is.read(reinterpret_cast<char *>(&key), sizeof(key))) {
+				insert(PatternWindow{key}, true);
+			}
+		}
+
+		PatternDatabase(const This &) = delete;
+		auto operator=(const This &) & -> PatternDatabase & = delete;
+		PatternDatabase(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> PatternDatabase & = delete;
+		~PatternDatabase() = default;
+
+		//is_box(cell) tells whether a box occupies the cell, including the box at `box` itself. Windows with
+		//fewer than two boxes off goals are left to the dead squares, which know the whole board.
+		template<typename IsBox>
+		[[nodiscard]] auto is_dead(const Board &board, Cell box, const IsBox &is_box) const -> bool {
+			auto window = PatternWindow{board, box, is_box};
+			if (window.number_of_boxes() < 2) {
+				return false;
+			}
+
+			{
+				auto lock = std::shared_lock{mutex};
+				if (auto it = patterns.find(window.key()); it != patterns.end()) {
+					return it->second;
+				}
+			}
+
+			auto is_dead = PatternAnalysis{}.is_dead(window);
+
+			auto lock = std::unique_lock{mutex};
+			if (patterns.size() > max_cached_patterns) {
+				std::erase_if(patterns, [](const auto &pattern) { return !pattern.second; });
+			}
+			if (insert(window, is_dead) && is_dead) {
+				unsaved.push_back(window.canonical_key());
+			}
+			return is_dead;
+		}
+
+		[[nodiscard]] auto number_of_dead_patterns() const -> size_t {
+			auto lock = std::shared_lock{mutex};
+			return static_cast<size_t>(std::count_if(RANGE(patterns), [](const auto &pattern) {
+				return pattern.second && PatternWindow{pattern.first}.canonical_key() == pattern.first;
+			}));
+		}
+
+		//Appends the dead windows found since the last save.
+		void save() {
+			auto lock = std::unique_lock{mutex};
+			if (!maybe_path || unsaved.empty()) {
+				return;
+			}
+			auto os = std::ofstream{*maybe_path, std::ios::binary | (is_file_stale ? std::ios::trunc : std::ios::app)};
+			if (!os) {
+				throw std::runtime_error{"Cannot write " + maybe_path->string() + "."};
+			}
+			if (is_file_stale) {
+				os.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+				os.write(reinterpret_cast<const char *>(&version), sizeof(version));
+				is_file_stale = false;
+			}
+			os.write(reinterpret_cast<const char *>(unsaved.data()), static_cast<std::streamsize>(unsaved.size() * sizeof(std::uint64_t)));
+			unsaved.clear();
+		}
+	};
+
+} //namespace sstm
@@ -0,0 +1,454 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+#include "reachability.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+#include <cool/filesystem.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	struct ExternalMemoryOptions {
+		//Where run and layer files go. Created if missing; the files are removed once the search ends.
+		stdc::fs::path directory;
+		//Bytes of generated states kept in memory before they are sorted and spilled to disk.
+		size_t memory_limit = size_t{1} << 30;
+	};
+
+	//Writes states in strictly ascending order. Each is stored as the number of leading cells it shares with
+	//the previous one, followed by the rest as LEB128 varints, the first of them relative to the previous state.
+	class StateFileWriter {
+	private:
+		std::ofstream os;
+		std::vector<Cell> previous;
+		bool is_empty = true;
+
+		void write_varint(std::uint32_t value) {
+			while (value >= 0x80) {
+				os.put(static_cast<char>((value & 0x7f) | 0x80));
+				value >>= 7;
+			}
+			os.put(static_cast<char>(value));
+		}
+
+	public:
+		StateFileWriter(const stdc::fs::path &path, size_t state_size) :
+			os{path, std::ios::binary | std::ios::trunc},
+			previous(state_size)
+		{
+			if (!os) {
+				throw std::runtime_error{"Cannot write " + path.string() + "."};
+			}
+		}
+
+		void write(const Cell *state) {
+			auto shared = size_t{};
+			while (!is_empty && shared < previous.size() && state[shared] == previous[shared]) {
+				++shared;
+			}
+			assert(shared < previous.size() && state[shared] >= previous[shared]);
+
+			write_varint(static_cast<std::uint32_t>(shared));
+			write_varint(static_cast<std::uint32_t>(state[shared] - previous[shared]));
+			for (auto i = shared + 1; i < previous.size(); ++i) {
+				write_varint(state[i]);
+			}
+			std::copy(state, state + previous.size(), previous.begin());
+			is_empty = false;
+		}
+	};
+
+	class StateFileReader {
+	private:
+		std::ifstream is;
+		std::vector<Cell> state;
+		bool has_state = false;
+
+		[[nodiscard]] auto read_varint() -> std::uint32_t {
+			auto value = std::uint32_t{};
+			for (auto shift = 0u; ; shift += 7) {
+				auto byte = is.get();
+				if (byte == std::ifstream::traits_type::eof()) {
+					throw std::runtime_error{"Truncated state file."};
+				}
+				value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+				if (!(byte & 0x80)) {
+					return value;
+				}
+			}
+		}
+
+	public:
+		StateFileReader(const stdc::fs::path &path, size_t state_size) :
+			is{path, std::ios::binary},
+			state(state_size)
+		{
+			if (!is) {
+				throw std::runtime_error{"Cannot read " + path.string() + "."};
+			}
+			advance();
+		}
+
+		[[nodiscard]] auto is_done() const -> bool { return !has_state; }
+		[[nodiscard]] auto get() const -> const Cell * { return state.data(); }
+
+		void advance() {
+			has_state = is.peek() != std::ifstream::traits_type::eof();
+			if (!has_state) {
+				return;
+			}
+			auto shared = read_varint();
+			if (shared >= state.size()) {
+				throw std::runtime_error{"Corrupt state file."};
+			}
+			state[shared] = static_cast<Cell>(state[shared] + read_varint());
+			for (auto i = size_t{shared} + 1; i < state.size(); ++i) {
+				state[i] = static_cast<Cell>(read_varint());
+			}
+		}
+	};
+
+	//Breadth-first search over pushes for state spaces that do not fit in memory. States are the sorted boxes
+	//followed by the normalized player. Children are buffered per layer (their cost in pushes) up to the memory
+	//limit, then sorted and spilled as run files. A layer is finished by merging its runs and streaming them
+	//against the sorted file of all visited states, which drops duplicates and writes the next visited file in
+	//the same pass. No parents are stored: the solution is traced back by expanding earlier layers again.
+	//Plain breadth-first search would store every state closer than the solution, so children whose
+	//estimate exceeds a bound are dropped, and the search restarts with the smallest dropped estimate
+	//as the bound until it finds a solution (breadth-first iterative deepening). The first one is push-optimal.
+	class ExternalSolver {
+	private:
+		using This = ExternalSolver;
+
+		struct PendingLayer {
+			std::vector<Cell> states;
+			std::vector<stdc::fs::path> runs;
+		};
+
+		static constexpr auto max_runs_per_merge = size_t{64};
+		static constexpr auto no_bound = std::numeric_limits<std::uint32_t>::max();
+
+		const Board &board;
+		SolverOptions options;
+		ExternalMemoryOptions external_options;
+		size_t number_of_boxes;
+		size_t state_size;
+
+		Position position;
+		SuccessorGenerator successors;
+
+		std::map<std::uint32_t, PendingLayer> pending;
+		std::map<std::uint32_t, stdc::fs::path> layers;
+		stdc::fs::path visited;
+		size_t buffered_cells = 0;
+		std::uint32_t bound = no_bound;
+		std::uint32_t next_bound = no_bound;
+
+		std::vector<stdc::fs::path> files;
+		size_t number_of_files = 0;
+
+		std::vector<Cell> state;
+		std::vector<std::uint32_t> order;
+		SolverStatistics statistics;
+
+		[[nodiscard]] auto less(const Cell *lhs, const Cell *rhs) const -> bool {
+			return std::lexicographical_compare(lhs, lhs + state_size, rhs, rhs + state_size);
+		}
+
+		[[nodiscard]] auto equal(const Cell *lhs, const Cell *rhs) const -> bool {
+			return std::equal(lhs, lhs + state_size, rhs);
+		}
+
+		[[nodiscard]] auto new_file(std::string_view kind) -> stdc::fs::path {
+			auto path = external_options.directory / (std::string{kind} + '_' + std::to_string(number_of_files++));
+			files.push_back(path);
+			return path;
+		}
+
+		static void remove_file(const stdc::fs::path &path) {
+			auto error = std::error_code{};
+			stdc::fs::remove(path, error);
+		}
+
+		void remove_files() {
+			std::for_each(RANGE(files), remove_file);
+			files.clear();
+			pending.clear();
+			layers.clear();
+			buffered_cells = 0;
+		}
+
+		void store_current(Cell player) {
+			position.store_sorted(state.data());
+			state[number_of_boxes] = player;
+		}
+
+		void spill(PendingLayer &layer) {
+			auto number_of_states = layer.states.size() / state_size;
+			order.resize(number_of_states);
+			for (auto i = size_t{}; i < number_of_states; ++i) {
+				order[i] = static_cast<std::uint32_t>(i);
+			}
+			auto state_at = [&](std::uint32_t index) { return layer.states.data() + index * state_size; };
+			std::sort(RANGE(order), [&](std::uint32_t lhs, std::uint32_t rhs) { return less(state_at(lhs), state_at(rhs)); });
+
+			auto run = new_file("run");
+			auto writer = StateFileWriter{run, state_size};
+			for (auto i = size_t{}; i < number_of_states; ++i) {
+				if (!i || !equal(state_at(order[i - 1]), state_at(order[i]))) {
+					writer.write(state_at(order[i]));
+				}
+			}
+			layer.runs.push_back(run);
+
+			buffered_cells -= layer.states.size();
+			layer.states = std::vector<Cell>{};
+		}
+
+		void add_state(std::uint32_t cost) {
+			auto &layer = pending[cost];
+			layer.states.insert(layer.states.end(), RANGE(state));
+			buffered_cells += state_size;
+
+			if (buffered_cells * sizeof(Cell) > external_options.memory_limit) {
+				for (auto &[layer_cost, spilled_layer] : pending) {
+					if (!spilled_layer.states.empty()) {
+						spill(spilled_layer);
+					}
+				}
+			}
+		}
+
+		//Calls consume(state) for each distinct state of the runs, in ascending order.
+		template<typename Consume>
+		void merge(const std::vector<stdc::fs::path> &runs, const Consume &consume) {
+			auto readers = std::vector<StateFileReader>{};
+			readers.reserve(runs.size());
+			for (const auto &run : runs) {
+				readers.emplace_back(run, state_size);
+			}
+
+			auto greater = [&](size_t lhs, size_t rhs) { return less(readers[rhs].get(), readers[lhs].get()); };
+			auto heap = std::priority_queue<size_t, std::vector<size_t>, decltype(greater)>{greater};
+			for (auto i = size_t{}; i < readers.size(); ++i) {
+				if (!readers[i].is_done()) {
+					heap.push(i);
+				}
+			}
+
+			auto last = std::vector<Cell>(state_size);
+			auto has_last = false;
+			while (!heap.empty()) {
+				auto i = heap.top();
+				heap.pop();
+				if (!has_last || !equal(last.data(), readers[i].get())) {
+					consume(readers[i].get());
+					std::copy(readers[i].get(), readers[i].get() + state_size, last.begin());
+					has_last = true;
+				}
+				readers[i].advance();
+				if (!readers[i].is_done()) {
+					heap.push(i);
+				}
+			}
+		}
+
+		//Merges the runs of the cheapest pending layer into its layer file, minus the visited states.
+		//Returns a solved state of the layer, if there is one.
+		[[nodiscard]] auto finish_layer(std::uint32_t cost) -> std::optional<std::vector<Cell>> {
+			auto &layer = pending[cost];
+			if (!layer.states.empty()) {
+				spill(layer);
+			}
+			while (layer.runs.size() > max_runs_per_merge) {
+				auto group = std::vector<stdc::fs::path>(layer.runs.end() - max_runs_per_merge, layer.runs.end());
+				layer.runs.resize(layer.runs.size() - max_runs_per_merge);
+				auto run = new_file("run");
+				auto writer = StateFileWriter{run, state_size};
+				merge(group, [&](const Cell *merged) { writer.write(merged); });
+				std::for_each(RANGE(group), remove_file);
+				layer.runs.push_back(run);
+			}
+
+			auto maybe_solved = std::optional<std::vector<Cell>>{};
+			auto layer_path = new_file("layer");
+			auto next_visited = new_file("visited");
+			{
+				auto layer_writer = StateFileWriter{layer_path, state_size};
+				auto visited_writer = StateFileWriter{next_visited, state_size};
+				auto visited_reader = StateFileReader{visited, state_size};
+
+				merge(layer.runs, [&](const Cell *candidate) {
+					for (; !visited_reader.is_done() && less(visited_reader.get(), candidate); visited_reader.advance()) {
+						visited_writer.write(visited_reader.get());
+					}
+					if (!visited_reader.is_done() && equal(visited_reader.get(), candidate)) {
+						return;
+					}
+					layer_writer.write(candidate);
+					visited_writer.write(candidate);
+					++statistics.stored_states;
+
+					if (!maybe_solved && std::all_of(candidate, candidate + number_of_boxes, [&](Cell box) { return board.is_goal(box); })) {
+						maybe_solved.emplace(candidate, candidate + state_size);
+					}
+				});
+				for (; !visited_reader.is_done(); visited_reader.advance()) {
+					visited_writer.write(visited_reader.get());
+				}
+			}
+
+			std::for_each(RANGE(layer.runs), remove_file);
+			remove_file(visited);
+			visited = next_visited;
+			layers[cost] = layer_path;
+			pending.erase(cost);
+			return maybe_solved;
+		}
+
+		//Returns false if the node limit was hit before the layer was done.
+		[[nodiscard]] auto expand_layer(std::uint32_t cost) -> bool {
+			for (auto reader = StateFileReader{layers[cost], state_size}; !reader.is_done(); reader.advance()) {
+				if (statistics.expanded_nodes >= options.max_expanded_nodes) {
+					return false;
+				}
+				position.load(reader.get(), number_of_boxes, reader.get()[number_of_boxes]);
+				successors.for_each_child(position, statistics, [&](Push, std::uint32_t length, Cell player, const auto &compute_lower_bound) {
+					++statistics.generated_nodes;
+					auto maybe_lower_bound = compute_lower_bound();
+					if (!maybe_lower_bound) {
+						return;
+					}
+					auto estimate = cost + length + *maybe_lower_bound;
+					if (estimate > bound) {
+						stdc::minimize(next_bound, estimate);
+						return;
+					}
+					store_current(player);
+					add_state(cost + length);
+				});
+			}
+			return true;
+		}
+
+		//Walks back from the solved state, each time scanning earlier layers for a state that has it as a child.
+		[[nodiscard]] auto reconstruct(std::vector<Cell> target, std::uint32_t cost) -> std::optional<std::string> {
+			auto pushes = std::vector<Push>{};
+			auto scratch_statistics = SolverStatistics{};
+
+			while (cost > 0) {
+				auto found = false;
+				for (auto it = layers.lower_bound(cost); !found && it != layers.begin();) {
+					--it;
+					auto length = cost - it->first;
+					for (auto reader = StateFileReader{it->second, state_size}; !found && !reader.is_done(); reader.advance()) {
+						position.load(reader.get(), number_of_boxes, reader.get()[number_of_boxes]);
+						successors.for_each_child(position, scratch_statistics, [&](Push push, std::uint32_t child_length, Cell player, const auto &) {
+							if (found || child_length != length) {
+								return;
+							}
+							store_current(player);
+							if (state == target) {
+								pushes.push_back(push);
+								found = true;
+							}
+						});
+						if (found) {
+							target.assign(reader.get(), reader.get() + state_size);
+							cost = it->first;
+						}
+					}
+				}
+				if (!found) {
+					return std::nullopt;
+				}
+			}
+
+			std::reverse(RANGE(pushes));
+			return pushes_to_lurd(board, successors.expand_macros(pushes));
+		}
+
+	public:
+		ExternalSolver(const Board &_board, SolverOptions _options, ExternalMemoryOptions _external_options) :
+			board{_board},
+			options{_options},
+			external_options{std::move(_external_options)},
+			number_of_boxes{_board.get_initial_boxes().size()},
+			state_size{number_of_boxes + 1},
+			position{_board},
+			successors{_board, _options},
+			state(state_size)
+		{}
+
+		ExternalSolver(const This &) = delete;
+		auto operator=(const This &) & -> ExternalSolver & = delete;
+		ExternalSolver(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> ExternalSolver & = delete;
+
+		~ExternalSolver() {
+			remove_files();
+		}
+
+		[[nodiscard]] auto run() -> SolverResult {
+			auto start = std::chrono::steady_clock::now();
+			auto result = SolverResult{};
+
+			stdc::fs::create_directories(external_options.directory);
+			auto root = std::vector<Cell>(state_size);
+			position.store_sorted(root.data());
+			root[number_of_boxes] = successors.normalized_player(position);
+
+			auto has_given_up = false;
+			next_bound = successors.lower_bound_of(position).value_or(no_bound);
+			while (next_bound != no_bound && !result.solution && !has_given_up) {
+				bound = std::exchange(next_bound, no_bound);
+				remove_files();
+				visited = new_file("visited");
+				StateFileWriter{visited, state_size};
+				state = root;
+				add_state(0);
+
+				while (!pending.empty() && !has_given_up) {
+					auto cost = pending.begin()->first;
+					if (auto maybe_solved = finish_layer(cost)) {
+						result.solution = reconstruct(std::move(*maybe_solved), cost);
+						break;
+					}
+					has_given_up = !expand_layer(cost);
+				}
+			}
+
+			result.proven_unsolvable = !result.solution && !has_given_up && !options.use_macros;
+
+			statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			result.statistics = statistics;
+			return result;
+		}
+	};
+
+	//Solves a level headlessly, breadth-first with the state sets on disk. Throws std::invalid_argument if the
+	//level is malformed and std::runtime_error if the files cannot be written or read.
+	[[nodiscard]] inline auto solve_externally(Level level, SolverOptions options, ExternalMemoryOptions external_options) -> SolverResult {
+		auto board = Board{level};
+		return ExternalSolver{board, options, std::move(external_options)}.run();
+	}
+
+} //namespace sstm
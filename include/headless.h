@@ -0,0 +1,349 @@
+#pragma once
+
+#include "sokoban_parser.h"
+#include "solver.h"
+#include "parallel_solver.h"
+#include "bidirectional_solver.h"
+#include "external_solver.h"
+#include "collection_checker.h"
+#include "room_solver.h"
+#include "portfolio_solver.h"
+#include "result_cache.h"
+
+#include <cool/filesystem.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace sstm {
+
+	inline void print_usage(std::ostream &os) {
+		os << "Usage: sstm [--solve <collection> [--threads <n> | --bidirectional | --external <directory> | --rooms | --portfolio [--time-limit <ms>] | --checkpoint <directory>] [--memory <MiB>] [--patterns <file>] [--cache <directory>]]\n"
+			"       sstm --check <collection> [--threads <n>] [--time-limit <ms>] [--memory <MiB>] [--patterns <file>] [--cache <directory>]\n"
+			"Without arguments, the game window opens.\n"
+			"--threads 0 uses every hardware thread, the default is the sequential solver.\n"
+			"--bidirectional searches forward from the level and backward from the goals at once.\n"
+			"--external searches breadth-first with the state sets in files under the directory,\n"
+			"keeping at most --memory MiB of new states in memory (1024 by default).\n"
+			"--rooms cuts the level into rooms at its doorways and solves them one after the other,\n"
+			"for levels too large to solve whole. The solutions are not push-optimal.\n"
+			"--portfolio races greedy, A*, bidirectional and macro searches on a thread each and keeps\n"
+			"the first answer, within --time-limit ms if given. Greedy and macro solutions may not be push-optimal.\n"
+			"--memory caps every other search at that many MiB, or the racers of --portfolio together. Once it is\n"
+			"full the searches forget the states that look worst and find them again later. Not with --threads or\n"
+			"--bidirectional, which search without a cap.\n"
+			"--checkpoint saves the search of the sequential solver for level i to <directory>/level_i.checkpoint\n"
+			"every 5 minutes and when it gives up, and resumes from there when run again.\n"
+			"--check validates every level on --threads threads (all by default) and solves it within\n"
+			"--time-limit ms (1000 by default). It writes one JSON object per level to standard output\n"
+			"and a summary to standard error.\n"
+			"--patterns prunes with the dead box patterns in the file and adds the ones found.\n"
+			"--cache looks every level up in the results in the directory, turned and mirrored too, before\n"
+			"solving the rest, and adds their solutions and proofs of unsolvability. Searches that promise\n"
+			"push-optimal solutions only take push-optimal ones from it.\n";
+	}
+
+	struct HeadlessOptions {
+		stdc::fs::path collection;
+		std::optional<size_t> maybe_number_of_threads;
+		bool bidirectional = false;
+		std::optional<ExternalMemoryOptions> maybe_external;
+		bool rooms = false;
+		bool portfolio = false;
+		bool check = false;
+		std::optional<std::chrono::milliseconds> maybe_time_limit;
+		std::optional<stdc::fs::path> maybe_pattern_file;
+		std::optional<stdc::fs::path> maybe_checkpoint_directory;
+		std::optional<stdc::fs::path> maybe_cache_directory;
+		//In bytes.
+		std::optional<size_t> maybe_memory_limit;
+	};
+
+	//Options for every level of a run, with the pattern database in `maybe_patterns` if there is one.
+	[[nodiscard]] inline auto make_solver_options(const HeadlessOptions &options, std::optional<PatternDatabase> &maybe_patterns) -> SolverOptions {
+		auto solver_options = SolverOptions{};
+		//The solutions of --rooms are not push-optimal anyway.
+		solver_options.use_macros = options.rooms;
+		if (options.maybe_pattern_file) {
+			solver_options.pattern_database = &maybe_patterns.emplace(*options.maybe_pattern_file);
+		}
+		if (!options.maybe_external) {
+			solver_options.maybe_memory_limit = options.maybe_memory_limit;
+		}
+		return solver_options;
+	}
+
+	inline void save_patterns(std::optional<PatternDatabase> &maybe_patterns, std::ostream &os) {
+		if (maybe_patterns) {
+			maybe_patterns->save();
+			os << "Dead patterns: " << maybe_patterns->number_of_dead_patterns() << ".\n";
+		}
+	}
+
+	inline void print_result(const SolverResult &result, std::ostream &os) {
+		const auto &statistics = result.statistics;
+		if (result.solution) {
+			os << "solved with " << std::count_if(RANGE(*result.solution), [](char c) { return 'A' <= c && c <= 'Z'; }) << " pushes";
+		} else if (result.proven_unsolvable) {
+			os << "unsolvable";
+		} else {
+			os << "gave up";
+		}
+		os << " (" << statistics.expanded_nodes << " nodes, " << static_cast<size_t>(statistics.nodes_per_second()) << " nodes/s";
+		if (statistics.forgotten_states) {
+			os << ", " << statistics.forgotten_states << " states forgotten";
+		}
+		os << ")\n";
+	}
+
+	inline void print_thread_statistics(const std::vector<ThreadStatistics> &threads, std::ostream &os) {
+		for (auto id = size_t{}; id < threads.size(); ++id) {
+			const auto &thread = threads[id];
+			os << "  thread " << id << ": " << thread.expanded_nodes << " nodes, "
+				<< static_cast<size_t>(thread.nodes_per_second()) << " nodes/s, "
+				<< thread.sent_states << " sent, " << thread.received_states << " received, "
+				<< thread.contended_pushes << " contended pushes, " << thread.idle_rounds << " idle rounds, "
+				<< thread.waiting_rounds << " waiting rounds\n";
+		}
+	}
+
+	//Malformed levels are not looked up, solving them tells what is wrong.
+	[[nodiscard]] inline auto look_up_results(const ResultCache &cache, const LevelStore &levels, bool requires_optimal) -> std::vector<std::optional<SolverResult>> {
+		auto results = std::vector<std::optional<SolverResult>>(levels.size());
+		for (auto level_id = size_t{}; level_id < levels.size(); ++level_id) {
+			try {
+				results[level_id] = cache.find(levels[level_id], requires_optimal);
+			} catch (std::invalid_argument &) {
+			}
+		}
+		return results;
+	}
+
+	inline void solve_collection(const HeadlessOptions &options, std::ostream &os) {
+		auto levels = parse_collection(options.collection);
+		os << "Parsed levels: " << levels.size() << ".\n";
+		if (options.maybe_checkpoint_directory) {
+			stdc::fs::create_directories(*options.maybe_checkpoint_directory);
+		}
+
+		//--rooms and --portfolio promise no push-optimal answer, so any cached one will do for them.
+		auto requires_optimal = !options.rooms && !options.portfolio;
+		auto maybe_cache = std::optional<ResultCache>{};
+		auto cached_results = std::vector<std::optional<SolverResult>>(levels.size());
+		if (options.maybe_cache_directory) {
+			maybe_cache.emplace(*options.maybe_cache_directory);
+			cached_results = look_up_results(*maybe_cache, levels, requires_optimal);
+			os << "Cached levels: " << std::count_if(RANGE(cached_results), [](const auto &maybe_result) { return maybe_result.has_value(); }) << ".\n";
+		}
+
+		auto maybe_patterns = std::optional<PatternDatabase>{};
+		auto solver_options = make_solver_options(options, maybe_patterns);
+		//Levels of a collection often share their floor.
+		auto room_cache = RoomDecompositionCache{};
+
+		for (auto level_id = size_t{}; level_id < levels.size(); ++level_id) {
+			os << "Level " << level_id << ": ";
+			try {
+				auto result = SolverResult{};
+				auto threads = std::vector<ThreadStatistics>{};
+				auto maybe_winner = std::optional<Strategy>{};
+				//A level may come up again within the collection.
+				if (maybe_cache && !cached_results[level_id]) {
+					cached_results[level_id] = maybe_cache->find(levels[level_id], requires_optimal);
+				}
+				if (cached_results[level_id]) {
+					result = *cached_results[level_id];
+				} else if (options.maybe_number_of_threads) {
+					auto number_of_threads = *options.maybe_number_of_threads ? *options.maybe_number_of_threads : size_t{std::thread::hardware_concurrency()};
+					auto parallel_result = solve_in_parallel(levels[level_id], solver_options, number_of_threads);
+					result = std::move(parallel_result.result);
+					threads = std::move(parallel_result.threads);
+				} else if (options.bidirectional) {
+					result = solve_bidirectional(levels[level_id], solver_options);
+				} else if (options.maybe_external) {
+					result = solve_externally(levels[level_id], solver_options, *options.maybe_external);
+				} else if (options.rooms) {
+					result = solve_by_rooms(levels[level_id], solver_options, &room_cache);
+				} else if (options.portfolio) {
+					auto portfolio_options = solver_options;
+					portfolio_options.maybe_time_limit = options.maybe_time_limit;
+					auto portfolio_result = solve_portfolio(levels[level_id], portfolio_options);
+					result = std::move(portfolio_result.result);
+					maybe_winner = portfolio_result.maybe_winner;
+				} else if (options.maybe_checkpoint_directory) {
+					auto checkpoint_options = solver_options;
+					checkpoint_options.maybe_checkpoint_path = *options.maybe_checkpoint_directory / ("level_" + std::to_string(level_id) + ".checkpoint");
+					result = solve(levels[level_id], checkpoint_options);
+				} else {
+					result = solve(levels[level_id], solver_options);
+				}
+				if (maybe_cache && !cached_results[level_id]) {
+					auto is_optimal = options.portfolio ? maybe_winner && is_push_optimal(*maybe_winner) : requires_optimal && solver_options.is_push_optimal();
+					//A room that cannot be solved in one order says little about the level.
+					auto is_complete = options.portfolio ? maybe_winner && can_prove_unsolvable(*maybe_winner) : !options.rooms && solver_options.can_prove_unsolvable();
+					maybe_cache->add(levels[level_id], result, is_optimal, is_complete);
+				}
+
+				print_result(result, os);
+				print_thread_statistics(threads, os);
+				if (maybe_winner) {
+					os << "  won by " << to_string(*maybe_winner) << '\n';
+				}
+				if (cached_results[level_id]) {
+					os << "  from the result cache\n";
+				}
+				if (result.solution) {
+					os << *result.solution << '\n';
+				}
+			} catch (std::exception &e) {
+				os << "invalid: " << e.what() << '\n';
+			}
+		}
+
+		save_patterns(maybe_patterns, os);
+		if (maybe_cache) {
+			maybe_cache->save();
+		}
+	}
+
+	inline void report_collection_check(const HeadlessOptions &options, std::ostream &report, std::ostream &summary) {
+		auto levels = parse_collection(options.collection);
+
+		auto maybe_patterns = std::optional<PatternDatabase>{};
+		auto checker_options = CheckerOptions{};
+		checker_options.solver_options = make_solver_options(options, maybe_patterns);
+		checker_options.number_of_threads = options.maybe_number_of_threads.value_or(0);
+		checker_options.time_limit = options.maybe_time_limit.value_or(checker_options.time_limit);
+		auto maybe_cache = std::optional<ResultCache>{};
+		if (options.maybe_cache_directory) {
+			checker_options.result_cache = &maybe_cache.emplace(*options.maybe_cache_directory);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto checks = check_collection(levels, checker_options);
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (maybe_cache) {
+			for (auto level_id = size_t{}; level_id < levels.size(); ++level_id) {
+				if (checks[level_id].maybe_result && !checks[level_id].is_cached) {
+					maybe_cache->add(levels[level_id], *checks[level_id].maybe_result, checks[level_id].is_optimal, checks[level_id].is_complete);
+				}
+			}
+			maybe_cache->save();
+		}
+
+		write_check_report(checks, report);
+
+		auto count = [&](std::string_view status) { return std::count_if(RANGE(checks), [&](const LevelCheck &check) { return check.status() == status; }); };
+		summary << "Checked " << checks.size() << " levels in " << seconds << " s: "
+			<< count("solved") << " solved, " << count("unsolvable") << " unsolvable, "
+			<< count("gave up") << " gave up, " << count("error") << " failed, " << count("malformed") << " malformed";
+		if (maybe_cache) {
+			summary << "; " << std::count_if(RANGE(checks), [](const LevelCheck &check) { return check.is_cached; }) << " from the cache";
+		}
+		summary << ".\n";
+		save_patterns(maybe_patterns, summary);
+	}
+
+	[[nodiscard]] inline auto parse_number(std::string_view text) -> std::optional<size_t> {
+		auto number = size_t{};
+		auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+		if (error != std::errc{} || end != text.data() + text.size()) {
+			return std::nullopt;
+		}
+		return number;
+	}
+
+	[[nodiscard]] inline auto parse_headless_options(const std::vector<std::string_view> &arguments) -> std::optional<HeadlessOptions> {
+		auto options = HeadlessOptions{};
+		auto has_collection = false;
+
+		for (auto i = size_t{1}; i < arguments.size(); ++i) {
+			auto has_value = i + 1 < arguments.size();
+			if ((arguments[i] == "--solve" || arguments[i] == "--check") && has_value && !has_collection) {
+				options.check = arguments[i] == "--check";
+				options.collection = arguments[++i];
+				has_collection = true;
+			} else if (arguments[i] == "--time-limit" && has_value) {
+				auto maybe_milliseconds = parse_number(arguments[++i]);
+				if (!maybe_milliseconds) {
+					return std::nullopt;
+				}
+				options.maybe_time_limit = std::chrono::milliseconds{*maybe_milliseconds};
+			} else if (arguments[i] == "--threads" && has_value) {
+				options.maybe_number_of_threads = parse_number(arguments[++i]);
+				if (!options.maybe_number_of_threads) {
+					return std::nullopt;
+				}
+			} else if (arguments[i] == "--checkpoint" && has_value) {
+				options.maybe_checkpoint_directory = arguments[++i];
+			} else if (arguments[i] == "--cache" && has_value) {
+				options.maybe_cache_directory = arguments[++i];
+			} else if (arguments[i] == "--patterns" && has_value) {
+				options.maybe_pattern_file = arguments[++i];
+			} else if (arguments[i] == "--bidirectional") {
+				options.bidirectional = true;
+			} else if (arguments[i] == "--rooms") {
+				options.rooms = true;
+			} else if (arguments[i] == "--portfolio") {
+				options.portfolio = true;
+			} else if (arguments[i] == "--external" && has_value) {
+				options.maybe_external.emplace().directory = arguments[++i];
+			} else if (arguments[i] == "--memory" && has_value) {
+				auto maybe_mebibytes = parse_number(arguments[++i]);
+				if (!maybe_mebibytes) {
+					return std::nullopt;
+				}
+				options.maybe_memory_limit = *maybe_mebibytes << 20;
+			} else {
+				return std::nullopt;
+			}
+		}
+
+		auto number_of_modes = options.bidirectional + options.rooms + options.portfolio + options.maybe_checkpoint_directory.has_value() + options.maybe_number_of_threads.has_value() + options.maybe_external.has_value();
+		if (!has_collection || number_of_modes > 1) {
+			return std::nullopt;
+		}
+		//The checker solves each level sequentially, on as many threads as there are levels to check.
+		if (options.check ? options.bidirectional || options.rooms || options.portfolio || options.maybe_checkpoint_directory.has_value() || options.maybe_external.has_value() : options.maybe_time_limit && !options.portfolio) {
+			return std::nullopt;
+		}
+		if (options.maybe_memory_limit && !options.check && (options.bidirectional || options.maybe_number_of_threads)) {
+			return std::nullopt;
+		}
+		if (options.maybe_memory_limit && options.maybe_external) {
+			options.maybe_external->memory_limit = *options.maybe_memory_limit;
+		}
+		return options;
+	}
+
+	//Handles the command line modes that run without a window. Returns the exit code if one of them ran.
+	[[nodiscard]] inline auto run_headless(const std::vector<std::string_view> &arguments) -> std::optional<int> {
+		if (arguments.size() <= 1) {
+			return std::nullopt;
+		}
+
+		auto maybe_options = parse_headless_options(arguments);
+		if (!maybe_options) {
+			print_usage(std::cerr);
+			return 1;
+		}
+
+		if (maybe_options->check) {
+			report_collection_check(*maybe_options, std::cout, std::cerr);
+		} else {
+			solve_collection(*maybe_options, std::cout);
+		}
+		return 0;
+	}
+
+} //namespace sstm
@@ -0,0 +1,413 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sstm {
+
+	struct Hint {
+		//The push to make next, nullopt if the position is solved or cannot be solved any more.
+		std::optional<Push> maybe_push;
+		//Pushes left on the best solution known. nullopt while maybe_push only leads to the most promising child.
+		std::optional<size_t> maybe_remaining_pushes;
+		//The remaining pushes are the fewest possible. Never set with macros on, which may cost optimality.
+		bool is_optimal = false;
+	};
+
+	//Suggests the next push for a game in progress. An anytime search runs on its own thread and improves the
+	//hint as it goes: the most promising child once the position is expanded, the first push of a solution once
+	//a weighted A* finds one, and of a push-optimal solution once plain A* bounded by it finishes.
+	//
+	//A new state interrupts the search within a slice of expansions. Walking keeps it running. Pushing along the
+	//best solution keeps the rest of that solution, which stays optimal if it was. Any other push restarts from
+	//the new state, but with the bounds learned so far: after a plain A*, every expanded state is at least the
+	//last expanded estimate minus its cost away from the goals (Real-Time Adaptive A*).
+	class HintEngine {
+	private:
+		using This = HintEngine;
+
+		struct Node {
+			std::uint64_t hash;
+			std::uint32_t parent;
+			std::uint32_t cost;
+			std::uint32_t lower_bound;
+			Cell player;
+			Cell pushed_box;
+			Direction direction;
+			bool closed;
+		};
+
+		static constexpr auto no_parent = std::numeric_limits<std::uint32_t>::max();
+		static constexpr auto no_bound = std::numeric_limits<std::uint32_t>::max();
+		static constexpr auto greedy_weight = std::uint32_t{3};
+		static constexpr auto expansions_per_slice = size_t{256};
+		static constexpr auto max_learned_bounds = size_t{1} << 22;
+
+		Board board;
+		SolverOptions options;
+		size_t number_of_boxes;
+
+		//Shared with the game.
+		std::mutex mutex;
+		std::condition_variable_any has_request;
+		std::condition_variable has_hint;
+		std::vector<Cell> requested_boxes;
+		Cell requested_player = no_cell;
+		size_t requested_generation = 0;
+		std::optional<Hint> maybe_hint;
+		size_t hint_generation = 0;
+
+		//Owned by the search thread.
+		Position position;
+		SuccessorGenerator successors;
+
+		std::vector<Cell> root_boxes;
+		Cell root_player = no_cell;
+		//Sorted boxes followed by the normalized player.
+		std::vector<Cell> root_state;
+
+		std::vector<Node> nodes;
+		std::vector<Cell> box_pool;
+		NodeTable table;
+		std::priority_queue<OpenEntry> open;
+		std::uint32_t weight = greedy_weight;
+		std::uint32_t last_estimate = 0;
+		SolverStatistics statistics;
+		bool is_finished = true;
+
+		//Pushes from the root, and the state before each of them and after the last.
+		std::optional<std::vector<Push>> maybe_incumbent;
+		std::vector<std::vector<Cell>> incumbent_states;
+		bool is_optimal = false;
+		bool is_proven_unsolvable = false;
+		std::optional<Push> maybe_promising;
+
+		//Keyed by the node hash, so a rare collision only weakens a hint.
+		std::unordered_map<std::uint64_t, std::uint32_t> learned_bounds;
+
+		//Last, so the thread is stopped and joined before anything it uses goes away.
+		std::jthread thread;
+
+		[[nodiscard]] auto boxes_of(std::uint32_t node) const -> const Cell * {
+			return box_pool.data() + static_cast<size_t>(node) * number_of_boxes;
+		}
+
+		[[nodiscard]] auto state_of_position() -> std::vector<Cell> {
+			auto state = std::vector<Cell>(number_of_boxes + 1);
+			position.store_sorted(state.data());
+			state.back() = successors.normalized_player(position);
+			return state;
+		}
+
+		[[nodiscard]] auto cost_limit() const -> std::uint32_t {
+			return maybe_incumbent ? static_cast<std::uint32_t>(maybe_incumbent->size()) : no_bound;
+		}
+
+		//States that cannot beat the incumbent are stored but never expanded.
+		void push_open(std::uint32_t index) {
+			const auto &node = nodes[index];
+			if (node.cost + node.lower_bound < cost_limit()) {
+				open.push(OpenEntry{node.cost + weight * node.lower_bound, node.lower_bound, node.cost, index});
+			}
+		}
+
+		//Solver::add_node, with the learned bounds and the weight.
+		template<typename ComputeLowerBound>
+		void add_node(std::uint32_t parent, std::uint32_t cost, Cell player, Push push, const ComputeLowerBound &compute_lower_bound) {
+			++statistics.generated_nodes;
+
+			auto hash = position.get_box_hash() ^ board.player_key(player);
+			auto candidate = static_cast<std::uint32_t>(nodes.size());
+
+			box_pool.resize(box_pool.size() + number_of_boxes);
+			position.store_sorted(box_pool.data() + static_cast<size_t>(candidate) * number_of_boxes);
+
+			auto hash_of = [&](std::uint32_t index) { return nodes[index].hash; };
+			auto equal = [&](std::uint32_t index) {
+				return nodes[index].player == player &&
+					std::equal(boxes_of(index), boxes_of(index) + number_of_boxes, boxes_of(candidate));
+			};
+
+			nodes.push_back(Node{hash, parent, cost, no_bound, player, push.box, push.direction, false});
+
+			if (auto maybe_existing = table.find_or_insert(hash, candidate, hash_of, equal)) {
+				nodes.pop_back();
+				box_pool.resize(box_pool.size() - number_of_boxes);
+
+				auto &existing = nodes[*maybe_existing];
+				if (existing.closed || existing.cost <= cost) {
+					return;
+				}
+				existing.parent = parent;
+				existing.cost = cost;
+				existing.pushed_box = push.box;
+				existing.direction = push.direction;
+				push_open(*maybe_existing);
+				return;
+			}
+
+			auto maybe_bound = compute_lower_bound();
+			if (!maybe_bound) {
+				nodes.back().closed = true;
+				return;
+			}
+			if (auto it = learned_bounds.find(hash); it != learned_bounds.end()) {
+				stdc::maximize(*maybe_bound, it->second);
+			}
+			nodes.back().lower_bound = *maybe_bound;
+			push_open(candidate);
+		}
+
+		//Only plain A* expands states in order of their estimate, which the learned bounds rely on.
+		void learn() {
+			if (weight != 1) {
+				return;
+			}
+			if (learned_bounds.size() > max_learned_bounds) {
+				learned_bounds.clear();
+			}
+			for (const auto &node : nodes) {
+				if (node.closed && node.lower_bound != no_bound && last_estimate > node.cost) {
+					stdc::maximize(learned_bounds[node.hash], last_estimate - node.cost);
+				}
+			}
+		}
+
+		void restart_search(std::uint32_t new_weight) {
+			learn();
+			nodes.clear();
+			box_pool.clear();
+			table = NodeTable{};
+			open = {};
+			weight = new_weight;
+			last_estimate = 0;
+			statistics = SolverStatistics{};
+			is_finished = false;
+
+			position.load(root_boxes, root_player);
+			add_node(no_parent, 0, successors.normalized_player(position), Push{no_cell, Direction::Up}, [&]() {
+				return successors.lower_bound_of(position);
+			});
+			if (nodes.front().lower_bound == no_bound) {
+				is_finished = true;
+				is_proven_unsolvable = true;
+			}
+		}
+
+		void set_incumbent(std::uint32_t node) {
+			auto pushes = std::vector<Push>{};
+			for (; nodes[node].parent != no_parent; node = nodes[node].parent) {
+				pushes.push_back(Push{nodes[node].pushed_box, nodes[node].direction});
+			}
+			std::reverse(RANGE(pushes));
+
+			position.load(root_boxes, root_player);
+			auto expanded = successors.expand_macros(position, pushes);
+			incumbent_states.clear();
+			incumbent_states.push_back(state_of_position());
+			for (auto push : expanded) {
+				position.move_box(position.index_of(push.box), board.neighbor(push.box, push.direction));
+				position.player = push.box;
+				incumbent_states.push_back(state_of_position());
+			}
+			maybe_incumbent = std::move(expanded);
+		}
+
+		void handle_request(const std::vector<Cell> &boxes, Cell player) {
+			position.load(boxes, player);
+			auto state = state_of_position();
+			if (state == root_state) {
+				return;
+			}
+			root_boxes = boxes;
+			root_player = player;
+			root_state = state;
+			maybe_promising = std::nullopt;
+			is_proven_unsolvable = false;
+
+			auto it = std::find(RANGE(incumbent_states), state);
+			if (it == incumbent_states.end()) {
+				maybe_incumbent = std::nullopt;
+				incumbent_states.clear();
+				is_optimal = false;
+				restart_search(greedy_weight);
+				return;
+			}
+
+			auto steps = it - incumbent_states.begin();
+			maybe_incumbent->erase(maybe_incumbent->begin(), maybe_incumbent->begin() + steps);
+			incumbent_states.erase(incumbent_states.begin(), it);
+			if (is_optimal || maybe_incumbent->empty()) {
+				learn();
+				is_optimal = true;
+				is_finished = true;
+				return;
+			}
+			restart_search(1);
+		}
+
+		//Returns whether the hint changed.
+		auto search_slice() -> bool {
+			for (auto i = size_t{}; i < expansions_per_slice; ++i) {
+				if (open.empty() || statistics.expanded_nodes >= options.max_expanded_nodes) {
+					//Without reopening, even the weighted search has seen every state by now. Not so with macros, which
+					//skip some, so then the hint falls back to the promising push.
+					is_proven_unsolvable = !maybe_incumbent && open.empty() && !options.use_macros;
+					is_optimal = maybe_incumbent && open.empty() && weight == 1;
+					is_finished = true;
+					return true;
+				}
+
+				auto entry = open.top();
+				open.pop();
+
+				auto &node = nodes[entry.node];
+				if (node.closed || node.cost != entry.cost) {
+					continue;
+				}
+				node.closed = true;
+				last_estimate = entry.estimate;
+
+				position.load(boxes_of(entry.node), number_of_boxes, node.player);
+				if (position.is_solved()) {
+					set_incumbent(entry.node);
+					if (weight == 1) {
+						is_optimal = true;
+						is_finished = true;
+					} else {
+						restart_search(1);
+					}
+					return true;
+				}
+
+				auto cost = node.cost;
+				successors.for_each_child(position, statistics, [&](Push push, std::uint32_t length, Cell player, const auto &compute_lower_bound) {
+					add_node(entry.node, cost + length, player, push, compute_lower_bound);
+				});
+
+				if (entry.node == 0 && !maybe_incumbent) {
+					auto best = no_bound;
+					for (auto child = size_t{1}; child < nodes.size(); ++child) {
+						if (nodes[child].lower_bound < best) {
+							best = nodes[child].lower_bound;
+							maybe_promising = Push{nodes[child].pushed_box, nodes[child].direction};
+						}
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		[[nodiscard]] auto current_hint() const -> std::optional<Hint> {
+			if (maybe_incumbent) {
+				auto maybe_push = maybe_incumbent->empty() ? std::nullopt : std::optional{maybe_incumbent->front()};
+				return Hint{maybe_push, maybe_incumbent->size(), is_optimal && !options.use_macros};
+			}
+			if (is_proven_unsolvable) {
+				return Hint{};
+			}
+			if (maybe_promising) {
+				return Hint{maybe_promising, std::nullopt, false};
+			}
+			return std::nullopt;
+		}
+
+		void publish(size_t generation) {
+			{
+				auto lock = std::lock_guard{mutex};
+				maybe_hint = current_hint();
+				hint_generation = generation;
+			}
+			has_hint.notify_all();
+		}
+
+		void work(std::stop_token stop_token) {
+			auto handled_generation = size_t{};
+			while (true) {
+				auto boxes = std::vector<Cell>{};
+				auto player = no_cell;
+				{
+					auto lock = std::unique_lock{mutex};
+					//Idle once the search is done, until the game reports a new state.
+					if (!has_request.wait(lock, stop_token, [&]() { return requested_generation != handled_generation || !is_finished; })) {
+						return;
+					}
+					if (requested_generation != handled_generation) {
+						handled_generation = requested_generation;
+						boxes = requested_boxes;
+						player = requested_player;
+					}
+				}
+
+				if (player != no_cell) {
+					handle_request(boxes, player);
+					if (!is_finished) {
+						//The most promising push is ready after a single expansion.
+						search_slice();
+					}
+					publish(handled_generation);
+				} else if (search_slice()) {
+					publish(handled_generation);
+				}
+			}
+		}
+
+	public:
+		explicit HintEngine(const Board &_board, SolverOptions _options = {}) :
+			board{_board},
+			options{_options},
+			number_of_boxes{_board.get_initial_boxes().size()},
+			position{board},
+			successors{board, _options},
+			thread{[this](std::stop_token stop_token) { work(stop_token); }}
+		{}
+
+		HintEngine(const This &) = delete;
+		auto operator=(const This &) & -> HintEngine & = delete;
+		HintEngine(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> HintEngine & = delete;
+		~HintEngine() = default;
+
+		//Interrupts the search for the previous state. Cheap enough to call after every move.
+		void set_state(std::vector<Cell> boxes, Cell player) {
+			{
+				auto lock = std::lock_guard{mutex};
+				requested_boxes = std::move(boxes);
+				requested_player = player;
+				++requested_generation;
+			}
+			has_request.notify_one();
+		}
+
+		//The best hint known for the last state set so far, without waiting.
+		[[nodiscard]] auto get_hint() -> std::optional<Hint> {
+			auto lock = std::lock_guard{mutex};
+			return hint_generation == requested_generation ? maybe_hint : std::nullopt;
+		}
+
+		//Waits at most `budget` for a hint about the last state set, then returns the best one known.
+		[[nodiscard]] auto wait_for_hint(std::chrono::milliseconds budget) -> std::optional<Hint> {
+			auto lock = std::unique_lock{mutex};
+			has_hint.wait_for(lock, budget, [&]() { return hint_generation == requested_generation && maybe_hint; });
+			return hint_generation == requested_generation ? maybe_hint : std::nullopt;
+		}
+	};
+
+} //namespace sstm
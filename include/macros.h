@@ -0,0 +1,329 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+#include "reachability.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//Layout analysis for macro pushes, done once per level.
+	//Tunnels: a box pushed along a one-wide corridor, with the player in the corridor behind it, goes on
+	//until it leaves the corridor, the only thing the player can do with it from there.
+	//Goal rooms: goals behind a single entrance cell, with no box inside at the start. A box pushed through
+	//the entrance goes straight to the next goal of a fill order that never blocks the goals after it.
+	//Neither macro is guaranteed to keep solutions push-optimal, which is why SolverOptions only turns them on for
+	//searches that promise no optimal answer.
+	class MacroAnalysis {
+	private:
+		struct RoomEntry {
+			//The box comes in from the entrance along this direction.
+			Direction direction;
+			std::vector<Cell> fill_order;
+			//paths[k]: the pushes taking a box from the entrance to fill_order[k] once the first k goals are filled.
+			std::vector<std::vector<Push>> paths;
+		};
+
+		struct GoalRoom {
+			Cell entrance;
+			std::vector<Cell> cells;
+			std::vector<RoomEntry> entries;
+		};
+
+		static constexpr auto horizontal = std::uint8_t{1};
+		static constexpr auto vertical = std::uint8_t{2};
+
+		const Board *board = nullptr;
+		std::vector<std::uint8_t> tunnel_axes;
+		std::vector<std::uint8_t> room_entrances;
+		std::vector<GoalRoom> rooms;
+
+		[[nodiscard]] static auto axis_of(Direction direction) -> std::uint8_t {
+			return direction == Direction::Left || direction == Direction::Right ? horizontal : vertical;
+		}
+
+		[[nodiscard]] auto is_tunnel(Cell cell, Direction direction) const -> bool {
+			return tunnel_axes[cell] & axis_of(direction);
+		}
+
+		void find_tunnels() {
+			tunnel_axes.assign(board->number_of_cells(), 0);
+			for (auto cell = Cell{}; cell < board->number_of_cells(); ++cell) {
+				if (board->is_wall(cell)) {
+					continue;
+				}
+				auto is_wall_towards = [&](Direction direction) { return board->is_wall(board->neighbor(cell, direction)); };
+				if (is_wall_towards(Direction::Up) && is_wall_towards(Direction::Down)) {
+					tunnel_axes[cell] |= horizontal;
+				}
+				if (is_wall_towards(Direction::Left) && is_wall_towards(Direction::Right)) {
+					tunnel_axes[cell] |= vertical;
+				}
+			}
+		}
+
+		//Fewest pushes taking a lone box from the entrance to `goal` inside the room, the player starting
+		//outside behind it. `blocked` cells (filled goals) count as walls.
+		[[nodiscard]] auto find_room_path(const GoalRoom &room, Direction direction, Cell goal, const std::vector<std::uint8_t> &blocked) const -> std::optional<std::vector<Push>> {
+			auto n = board->number_of_cells();
+			auto in_room = std::vector<std::uint8_t>(n);
+			for (auto cell : room.cells) {
+				in_room[cell] = 1;
+			}
+			in_room[room.entrance] = 1;
+			auto outside = board->neighbor(room.entrance, opposite(direction));
+
+			//The player never needs to leave the room, everything outside is only reachable through the entrance.
+			auto occupied = std::vector<std::uint8_t>(n, 1);
+			for (auto cell = Cell{}; cell < n; ++cell) {
+				occupied[cell] = !(in_room[cell] || cell == outside) || blocked[cell];
+			}
+
+			struct State {
+				Cell box;
+				Cell player;
+				size_t parent;
+				Push push;
+			};
+			auto states = std::vector<State>{{room.entrance, outside, 0, Push{no_cell, Direction::Up}}};
+			auto seen = std::unordered_map<std::uint32_t, size_t>{};
+			auto key = [](Cell box, Cell player) { return std::uint32_t{box} << 16 | player; };
+			seen.emplace(key(room.entrance, outside), 0);
+
+			auto reachability = Reachability{};
+			auto child_reachability = Reachability{};
+			for (auto i = size_t{}; i < states.size(); ++i) {
+				auto state = states[i];
+				if (state.box == goal) {
+					auto path = std::vector<Push>{};
+					for (auto j = i; j; j = states[j].parent) {
+						path.push_back(states[j].push);
+					}
+					std::reverse(RANGE(path));
+					return path;
+				}
+
+				occupied[state.box] = 1;
+				reachability.compute(*board, occupied, state.player);
+				occupied[state.box] = 0;
+
+				for (auto push_direction : all_directions) {
+					auto stand = board->neighbor(state.box, opposite(push_direction));
+					auto target = board->neighbor(state.box, push_direction);
+					if (board->is_wall(stand) || !reachability.contains(stand) || !in_room[target] || board->is_wall(target) || blocked[target]) {
+						continue;
+					}
+
+					occupied[target] = 1;
+					child_reachability.compute(*board, occupied, state.box);
+					occupied[target] = 0;
+					auto player = child_reachability.normalized();
+					if (seen.emplace(key(target, player), states.size()).second) {
+						states.push_back(State{target, player, i, Push{state.box, push_direction}});
+					}
+				}
+			}
+			return std::nullopt;
+		}
+
+		//Fills the room goal by goal, deepest first, as long as every goal left stays reachable.
+		[[nodiscard]] auto make_entry(const GoalRoom &room, Direction direction, const std::vector<Cell> &goals) const -> std::optional<RoomEntry> {
+			auto entry = RoomEntry{direction, {}, {}};
+			auto blocked = std::vector<std::uint8_t>(board->number_of_cells());
+
+			while (entry.fill_order.size() < goals.size()) {
+				auto best_goal = no_cell;
+				auto best_path = std::vector<Push>{};
+				for (auto goal : goals) {
+					if (blocked[goal]) {
+						continue;
+					}
+					auto maybe_path = find_room_path(room, direction, goal, blocked);
+					if (!maybe_path || (best_goal != no_cell && maybe_path->size() <= best_path.size())) {
+						continue;
+					}
+
+					blocked[goal] = 1;
+					auto keeps_others_reachable = std::all_of(RANGE(goals), [&](Cell other) {
+						return blocked[other] || find_room_path(room, direction, other, blocked);
+					});
+					blocked[goal] = 0;
+
+					if (keeps_others_reachable) {
+						best_goal = goal;
+						best_path = std::move(*maybe_path);
+					}
+				}
+
+				if (best_goal == no_cell) {
+					return std::nullopt;
+				}
+				blocked[best_goal] = 1;
+				entry.fill_order.push_back(best_goal);
+				entry.paths.push_back(std::move(best_path));
+			}
+			return entry;
+		}
+
+		void find_goal_rooms() {
+			auto n = board->number_of_cells();
+			room_entrances.assign(n, 0);
+			auto is_articulation = find_articulation_points(*board);
+
+			auto is_initial_box = std::vector<std::uint8_t>(n);
+			for (auto box : board->get_initial_boxes()) {
+				is_initial_box[box] = 1;
+			}
+
+			//Nested candidates share their goals, the smallest area is the room proper.
+			auto candidates = std::vector<std::pair<GoalRoom, std::vector<Cell>>>{};
+			auto label = std::vector<std::uint32_t>(n);
+			auto next_label = std::uint32_t{};
+			for (auto entrance = Cell{}; entrance < n; ++entrance) {
+				if (!is_articulation[entrance] || board->is_goal(entrance)) {
+					continue;
+				}
+
+				//Each side of the entrance is one candidate, unless an earlier side already got around to it.
+				auto labels_before = next_label;
+				for (auto first_direction : all_directions) {
+					auto first = board->neighbor(entrance, first_direction);
+					if (board->is_wall(first) || label[first] > labels_before) {
+						continue;
+					}
+
+					++next_label;
+					label[entrance] = next_label;
+					auto room = GoalRoom{entrance, {first}, {}};
+					label[first] = next_label;
+					auto goals = std::vector<Cell>{};
+					auto is_usable = true;
+					for (auto i = size_t{}; i < room.cells.size(); ++i) {
+						auto cell = room.cells[i];
+						if (board->is_goal(cell)) {
+							goals.push_back(cell);
+						}
+						if (is_initial_box[cell] || cell == board->get_initial_player()) {
+							is_usable = false;
+						}
+						for (auto direction : all_directions) {
+							auto neighbor = board->neighbor(cell, direction);
+							if (!board->is_wall(neighbor) && label[neighbor] != next_label) {
+								label[neighbor] = next_label;
+								room.cells.push_back(neighbor);
+							}
+						}
+					}
+					label[entrance] = 0;
+
+					if (is_usable && !goals.empty()) {
+						std::sort(RANGE(goals));
+						candidates.emplace_back(std::move(room), std::move(goals));
+					}
+				}
+			}
+
+			std::sort(RANGE(candidates), [](const auto &lhs, const auto &rhs) {
+				return lhs.second != rhs.second ? lhs.second < rhs.second : lhs.first.cells.size() < rhs.first.cells.size();
+			});
+			for (auto i = size_t{}; i < candidates.size(); ++i) {
+				if (i > 0 && candidates[i].second == candidates[i - 1].second) {
+					continue;
+				}
+
+				auto &[room, goals] = candidates[i];
+				auto in_room = std::vector<std::uint8_t>(n);
+				for (auto cell : room.cells) {
+					in_room[cell] = 1;
+				}
+				for (auto direction : all_directions) {
+					auto inside = board->neighbor(room.entrance, direction);
+					auto outside = board->neighbor(room.entrance, opposite(direction));
+					if (!in_room[inside] || board->is_wall(outside) || in_room[outside]) {
+						continue;
+					}
+					if (auto maybe_entry = make_entry(room, direction, goals)) {
+						room.entries.push_back(std::move(*maybe_entry));
+					}
+				}
+
+				if (!room.entries.empty()) {
+					room_entrances[room.entrance] = 1;
+					rooms.push_back(std::move(room));
+				}
+			}
+		}
+
+		//The stored path for a box on the entrance, if the room is filled exactly up to some point of the order.
+		[[nodiscard]] auto room_path(const Position &position, Cell entrance, Direction direction) const -> const std::vector<Push> * {
+			for (const auto &room : rooms) {
+				if (room.entrance != entrance) {
+					continue;
+				}
+				for (const auto &entry : room.entries) {
+					if (entry.direction != direction) {
+						continue;
+					}
+					auto filled = static_cast<size_t>(std::count_if(RANGE(room.cells), [&](Cell cell) { return position.is_box(cell); }));
+					if (filled >= entry.fill_order.size()) {
+						return nullptr;
+					}
+					auto is_prefix = std::all_of(entry.fill_order.begin(), entry.fill_order.begin() + static_cast<ptrdiff_t>(filled), [&](Cell goal) {
+						return position.is_box(goal);
+					});
+					return is_prefix ? &entry.paths[filled] : nullptr;
+				}
+			}
+			return nullptr;
+		}
+
+	public:
+		MacroAnalysis() = default;
+
+		explicit MacroAnalysis(const Board &_board) :
+			board{&_board}
+		{
+			find_tunnels();
+			find_goal_rooms();
+		}
+
+		[[nodiscard]] auto number_of_goal_rooms() const { return rooms.size(); }
+
+		//Box `index` was just pushed in `direction`. Applies the macro pushes that follow, appends them to
+		//`pushes` and returns the cell the player ends up on.
+		auto complete(Position &position, size_t index, Direction direction, std::vector<Push> &pushes) const -> Cell {
+			auto box = position.get_boxes()[index];
+			while (true) {
+				if (room_entrances[box]) {
+					if (const auto *path = room_path(position, box, direction)) {
+						for (const auto &push : *path) {
+							position.move_box(index, board->neighbor(push.box, push.direction));
+						}
+						pushes.insert(pushes.end(), RANGE(*path));
+						return path->back().box;
+					}
+				}
+
+				auto next = board->neighbor(box, direction);
+				auto stand = board->neighbor(box, opposite(direction));
+				if (board->is_goal(box) || !is_tunnel(box, direction) || !is_tunnel(stand, direction) ||
+					!position.is_free(next) || board->is_dead_square(next)) {
+					return stand;
+				}
+				pushes.push_back(Push{box, direction});
+				position.move_box(index, next);
+				box = next;
+			}
+		}
+	};
+
+} //namespace sstm
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cool/filesystem.h>
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sstm {
+
+	//A whole file mapped read-only into memory. Pages are read in as they are touched, so opening is O(1) however
+	//large the file is. A missing or empty file maps to no bytes.
+	class MappedFile {
+	private:
+		using This = MappedFile;
+
+		const std::byte *data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE mapping = nullptr;
+#endif
+
+	public:
+		explicit MappedFile(const stdc::fs::path &path) {
+			auto error = std::error_code{};
+			auto file_size = stdc::fs::file_size(path, error);
+			if (error || file_size == 0) {
+				return;
+			}
+#ifdef _WIN32
+			auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				throw std::runtime_error{"Cannot read " + path.string() + "."};
+			}
+			mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+			auto view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (!view) {
+				if (mapping) {
+					CloseHandle(mapping);
+				}
+				throw std::runtime_error{"Cannot map " + path.string() + "."};
+			}
+			data = static_cast<const std::byte *>(view);
+#else
+			auto file = open(path.c_str(), O_RDONLY);
+			if (file < 0) {
+				throw std::runtime_error{"Cannot read " + path.string() + "."};
+			}
+			auto view = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file, 0);
+			close(file);
+			if (view == MAP_FAILED) {
+				throw std::runtime_error{"Cannot map " + path.string() + "."};
+			}
+			data = static_cast<const std::byte *>(view);
+#endif
+			size = file_size;
+		}
+
+		MappedFile(const This &) = delete;
+		auto operator=(const This &) & -> MappedFile & = delete;
+		MappedFile(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> MappedFile & = delete;
+
+		~MappedFile() {
+			if (!data) {
+				return;
+			}
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+			CloseHandle(mapping);
+#else
+			munmap(const_cast<std::byte *>(data), size);
+#endif
+		}
+
+		[[nodiscard]] auto bytes() const -> std::span<const std::byte> { return {data, size}; }
+	};
+
+} //namespace sstm
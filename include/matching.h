@@ -0,0 +1,151 @@
+#pragma once
+
+#include "board.h"
+
+#include <cool/algorithm.h>
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace sstm {
+
+	//What a MatchingLowerBound assigns the boxes to: goals for forward search, the initial boxes for
+	//search that pulls back from the goals.
+	enum class MatchingTargets : std::uint8_t {Goals, InitialBoxes};
+
+	//Minimum cost assignment of boxes to goals under Board::push_distance, an admissible lower bound
+	//on the pushes left (or to initial boxes under Board::pull_distance, on the pulls left). Keeps the
+	//Hungarian potentials around, so moving one box costs a single shortest augmenting path (O(n^2))
+	//instead of a new O(n^3) assignment.
+	class MatchingLowerBound {
+	private:
+		using Cost = std::int64_t;
+
+		//Stands in for unreachable goals, large enough that no finite matching can come close.
+		static constexpr auto infinite = Cost{1} << 32;
+
+		const Board *board = nullptr;
+		MatchingTargets targets = MatchingTargets::Goals;
+		size_t n = 0;
+
+		std::vector<Cell> boxes;
+		//Arrays are 1-based with index 0 as the virtual start, as in the textbook formulation.
+		std::vector<Cost> row_potentials;
+		std::vector<Cost> column_potentials;
+		std::vector<size_t> row_of_column;
+
+		std::vector<Cost> min_reduced;
+		std::vector<size_t> way;
+		std::vector<std::uint8_t> used;
+
+		[[nodiscard]] auto cost(size_t row, size_t column) const -> Cost {
+			auto distance = targets == MatchingTargets::Goals ?
+				board->push_distance(boxes[row - 1], column - 1) : board->pull_distance(boxes[row - 1], column - 1);
+			return distance == Board::unreachable ? infinite : Cost{distance};
+		}
+
+		//Successive shortest path step: matches the free row against the one free column.
+		void augment(size_t row) {
+			row_of_column[0] = row;
+			min_reduced.assign(n + 1, std::numeric_limits<Cost>::max());
+			way.assign(n + 1, 0);
+			used.assign(n + 1, 0);
+
+			auto column = size_t{};
+			do {
+				used[column] = 1;
+				auto current_row = row_of_column[column];
+				auto delta = std::numeric_limits<Cost>::max();
+				auto next_column = size_t{};
+
+				for (auto j = size_t{1}; j <= n; ++j) {
+					if (used[j]) {
+						continue;
+					}
+					auto reduced = cost(current_row, j) - row_potentials[current_row] - column_potentials[j];
+					if (reduced < min_reduced[j]) {
+						min_reduced[j] = reduced;
+						way[j] = column;
+					}
+					if (min_reduced[j] < delta) {
+						delta = min_reduced[j];
+						next_column = j;
+					}
+				}
+
+				for (auto j = size_t{}; j <= n; ++j) {
+					if (used[j]) {
+						row_potentials[row_of_column[j]] += delta;
+						column_potentials[j] -= delta;
+					} else {
+						min_reduced[j] -= delta;
+					}
+				}
+				column = next_column;
+			} while (row_of_column[column]);
+
+			do {
+				auto previous = way[column];
+				row_of_column[column] = row_of_column[previous];
+				column = previous;
+			} while (column);
+		}
+
+	public:
+		MatchingLowerBound() = default;
+
+		explicit MatchingLowerBound(const Board &_board, MatchingTargets _targets = MatchingTargets::Goals) :
+			board{&_board},
+			targets{_targets},
+			n{_board.get_goals().size()}
+		{}
+
+		void assign_all(const std::vector<Cell> &_boxes) {
+			assert(_boxes.size() == n);
+			boxes = _boxes;
+			row_potentials.assign(n + 1, 0);
+			column_potentials.assign(n + 1, 0);
+			row_of_column.assign(n + 1, 0);
+			for (auto row = size_t{1}; row <= n; ++row) {
+				augment(row);
+			}
+		}
+
+		//Box `index` (as in the vector given to assign_all) moved, all other boxes stayed.
+		void move_box(size_t index, Cell to) {
+			auto row = index + 1;
+			boxes[index] = to;
+
+			for (auto j = size_t{1}; j <= n; ++j) {
+				if (row_of_column[j] == row) {
+					row_of_column[j] = 0;
+				}
+			}
+
+			//Largest potential that keeps every reduced cost of the row non-negative.
+			auto potential = std::numeric_limits<Cost>::max();
+			for (auto j = size_t{1}; j <= n; ++j) {
+				stdc::minimize(potential, cost(row, j) - column_potentials[j]);
+			}
+			row_potentials[row] = potential;
+
+			augment(row);
+		}
+
+		//nullopt if the boxes cannot all reach distinct goals, which makes the position a deadlock.
+		[[nodiscard]] auto get_lower_bound() const -> std::optional<std::uint32_t> {
+			auto total = Cost{};
+			for (auto j = size_t{1}; j <= n; ++j) {
+				total += cost(row_of_column[j], j);
+			}
+			if (total >= infinite) {
+				return std::nullopt;
+			}
+			return static_cast<std::uint32_t>(total);
+		}
+	};
+
+} //namespace sstm
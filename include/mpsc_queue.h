@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace sstm {
+
+	//Unbounded lock-free multi-producer single-consumer queue (Vyukov's linked list design).
+	//Producers link a node in with one CAS on the head; the consumer walks the tail alone.
+	template<typename T>
+	class MpscQueue {
+	private:
+		using This = MpscQueue;
+
+		struct QueueNode {
+			std::atomic<QueueNode *> next{nullptr};
+			std::optional<T> value;
+		};
+
+		alignas(64) std::atomic<QueueNode *> head;
+		alignas(64) QueueNode *tail;
+
+		//Failed CAS attempts of producers, a direct measure of contention on this queue.
+		alignas(64) std::atomic<size_t> contended_pushes{0};
+
+	public:
+		MpscQueue() {
+			auto *stub = new QueueNode{};
+			head.store(stub, std::memory_order_relaxed);
+			tail = stub;
+		}
+
+		MpscQueue(const This &) = delete;
+		auto operator=(const This &) & -> MpscQueue & = delete;
+		MpscQueue(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> MpscQueue & = delete;
+
+		~MpscQueue() {
+			while (tail) {
+				delete std::exchange(tail, tail->next.load(std::memory_order_relaxed));
+			}
+		}
+
+		//Any thread.
+		void push(T value) {
+			auto *node = new QueueNode{};
+			node->value.emplace(std::move(value));
+
+			auto *previous = head.load(std::memory_order_relaxed);
+			while (!head.compare_exchange_weak(previous, node, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				contended_pushes.fetch_add(1, std::memory_order_relaxed);
+			}
+			previous->next.store(node, std::memory_order_release);
+		}
+
+		//Owning thread only. Returns nullopt if the queue is empty, or a producer has not finished linking yet.
+		[[nodiscard]] auto pop() -> std::optional<T> {
+			auto *next = tail->next.load(std::memory_order_acquire);
+			if (!next) {
+				return std::nullopt;
+			}
+
+			auto result = std::move(next->value);
+			next->value.reset();
+			delete std::exchange(tail, next);
+			return result;
+		}
+
+		[[nodiscard]] auto get_contended_pushes() const {
+			return contended_pushes.load(std::memory_order_relaxed);
+		}
+	};
+
+} //namespace sstm
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "board.h"
+#include "mpsc_queue.h"
+#include "position.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sstm {
+
+	struct ThreadStatistics {
+		size_t expanded_nodes = 0;
+		size_t generated_nodes = 0;
+		size_t sent_states = 0;
+		size_t received_states = 0;
+		//Failed CAS attempts of other threads pushing into this thread's queue.
+		size_t contended_pushes = 0;
+		//Rounds this thread found neither local work nor incoming states.
+		size_t idle_rounds = 0;
+		//Rounds this thread had open states, but none close enough to the global frontier to expand.
+		size_t waiting_rounds = 0;
+		double seconds = 0.;
+
+		[[nodiscard]] auto nodes_per_second() const -> double {
+			return seconds > 0. ? static_cast<double>(expanded_nodes) / seconds : 0.;
+		}
+	};
+
+	struct ParallelSolverResult {
+		SolverResult result;
+		std::vector<ThreadStatistics> threads;
+	};
+
+	//Hash-distributed A* (HDA*): every state is owned by the thread its Zobrist hash selects, which alone
+	//stores and expands it. Children owned by other threads are sent over lock-free MPSC queues in batches.
+	//A found solution becomes the incumbent, and search goes on until no thread holds a cheaper open state,
+	//so without macros the result is push-optimal like the sequential Solver.
+	class ParallelSolver {
+	private:
+		using This = ParallelSolver;
+		using NodeRef = std::uint64_t;
+
+		static constexpr auto no_parent = std::numeric_limits<NodeRef>::max();
+		static constexpr auto deadlock = std::numeric_limits<std::uint32_t>::max();
+		static constexpr auto batch_size = size_t{128};
+		static constexpr auto expansions_per_round = size_t{64};
+		static constexpr auto empty_frontier = std::numeric_limits<std::uint64_t>::max();
+		//How far above the lowest estimate of all threads a thread may expand. Estimates of a push and its parent
+		//differ by 0 or 2 under the matching bound, so this lets every thread work on the next layer as well.
+		static constexpr auto frontier_band = std::uint64_t{2};
+
+		//The open list order as one number: estimate first, then lower bound.
+		[[nodiscard]] static constexpr auto priority_of(const OpenEntry &entry) -> std::uint64_t {
+			return (std::uint64_t{entry.estimate} << 32) | entry.lower_bound;
+		}
+
+		[[nodiscard]] static constexpr auto make_ref(size_t thread, std::uint32_t node) -> NodeRef {
+			return (NodeRef{thread} << 32) | node;
+		}
+
+		struct Node {
+			std::uint64_t hash;
+			NodeRef parent;
+			std::uint32_t cost;
+			std::uint32_t lower_bound;
+			Cell player;
+			Cell pushed_box;
+			Direction direction;
+			bool closed;
+		};
+
+		struct StateMessage {
+			std::uint64_t hash;
+			NodeRef parent;
+			std::uint32_t cost;
+			std::uint32_t lower_bound;
+			Cell player;
+			Cell pushed_box;
+			Direction direction;
+		};
+
+		//States and their sorted boxes, number_of_boxes per state.
+		struct Batch {
+			std::vector<StateMessage> states;
+			std::vector<Cell> boxes;
+			std::uint64_t best_priority = empty_frontier;
+		};
+
+		class Worker {
+		private:
+			This &shared;
+			size_t id;
+
+			std::vector<Node> nodes;
+			std::vector<Cell> box_pool;
+			NodeTable table;
+			std::priority_queue<OpenEntry> open;
+
+			Position position;
+			SuccessorGenerator successors;
+			std::vector<Batch> outgoing;
+			bool is_idle = false;
+
+			SolverStatistics statistics;
+			ThreadStatistics thread_statistics;
+
+			[[nodiscard]] auto boxes_of(std::uint32_t node) const -> const Cell * {
+				return box_pool.data() + static_cast<size_t>(node) * shared.number_of_boxes;
+			}
+
+			//store_boxes(destination) writes the sorted boxes of the state.
+			template<typename StoreBoxes, typename ComputeLowerBound>
+			void add_node(const StateMessage &state, const StoreBoxes &store_boxes, const ComputeLowerBound &compute_lower_bound) {
+				auto n = shared.number_of_boxes;
+				auto candidate = static_cast<std::uint32_t>(nodes.size());
+				box_pool.resize(box_pool.size() + n);
+				store_boxes(box_pool.data() + static_cast<size_t>(candidate) * n);
+
+				auto hash_of = [&](std::uint32_t index) { return nodes[index].hash; };
+				auto equal = [&](std::uint32_t index) {
+					return nodes[index].player == state.player &&
+						std::equal(boxes_of(index), boxes_of(index) + n, boxes_of(candidate));
+				};
+
+				nodes.push_back(Node{state.hash, state.parent, state.cost, 0, state.player, state.pushed_box, state.direction, false});
+
+				if (auto maybe_existing = table.find_or_insert(state.hash, candidate, hash_of, equal)) {
+					nodes.pop_back();
+					box_pool.resize(box_pool.size() - n);
+
+					//Other threads expand in a different order, so a cheaper path can show up for a closed state.
+					auto &existing = nodes[*maybe_existing];
+					if (existing.lower_bound == deadlock || existing.cost <= state.cost) {
+						return;
+					}
+					existing.parent = state.parent;
+					existing.cost = state.cost;
+					existing.pushed_box = state.pushed_box;
+					existing.direction = state.direction;
+					existing.closed = false;
+					open.push(OpenEntry{state.cost + existing.lower_bound, existing.lower_bound, state.cost, *maybe_existing});
+					return;
+				}
+
+				auto maybe_bound = compute_lower_bound();
+				if (!maybe_bound) {
+					nodes.back().lower_bound = deadlock;
+					nodes.back().closed = true;
+					return;
+				}
+				nodes.back().lower_bound = *maybe_bound;
+				open.push(OpenEntry{state.cost + *maybe_bound, *maybe_bound, state.cost, candidate});
+			}
+
+			void send(size_t owner, const StateMessage &state) {
+				auto &batch = outgoing[owner];
+				batch.states.push_back(state);
+				stdc::minimize(batch.best_priority, priority_of(OpenEntry{state.cost + state.lower_bound, state.lower_bound, state.cost, 0}));
+				batch.boxes.resize(batch.boxes.size() + shared.number_of_boxes);
+				position.store_sorted(batch.boxes.data() + batch.boxes.size() - shared.number_of_boxes);
+				if (batch.states.size() >= batch_size) {
+					flush(owner);
+				}
+			}
+
+			void flush(size_t owner) {
+				auto &batch = outgoing[owner];
+				if (batch.states.empty()) {
+					return;
+				}
+				thread_statistics.sent_states += batch.states.size();
+				shared.in_flight.fetch_add(batch.states.size());
+				auto &receiver = *shared.workers[owner];
+				//Announced after the push, so that the receiver cannot clear the announcement and then miss the
+				//batch. An announcement for a batch already received only holds the frontier low for a round.
+				auto priority = batch.best_priority;
+				receiver.inbox.push(std::move(batch));
+				receiver.announce(priority);
+				batch = Batch{};
+			}
+
+			void flush_all() {
+				for (auto owner = size_t{}; owner < outgoing.size(); ++owner) {
+					flush(owner);
+				}
+			}
+
+			[[nodiscard]] auto receive() -> bool {
+				//Whatever was announced so far is either popped below or in the open list already.
+				announced.store(empty_frontier, std::memory_order_relaxed);
+				auto received_any = false;
+				while (auto maybe_batch = inbox.pop()) {
+					if (is_idle) {
+						//Announce the wake up before touching in_flight, see can_terminate.
+						shared.epoch.fetch_add(1);
+						shared.idle_workers.fetch_sub(1);
+						is_idle = false;
+					}
+					received_any = true;
+
+					const auto &batch = *maybe_batch;
+					auto n = shared.number_of_boxes;
+					for (auto i = size_t{}; i < batch.states.size(); ++i) {
+						const auto &state = batch.states[i];
+						add_node(state, [&](Cell *destination) {
+							std::copy_n(batch.boxes.data() + i * n, n, destination);
+						}, [&]() {
+							return std::optional{state.lower_bound};
+						});
+					}
+					thread_statistics.received_states += batch.states.size();
+					//The states are in the open list now. Announce that again, or a check that saw us idle before
+					//the wake up could see in_flight drop to 0 and the epoch it started with.
+					shared.epoch.fetch_add(1);
+					shared.in_flight.fetch_sub(batch.states.size());
+				}
+				return received_any;
+			}
+
+			void expand(std::uint32_t node) {
+				position.load(boxes_of(node), shared.number_of_boxes, nodes[node].player);
+				if (position.is_solved()) {
+					shared.report_solution(make_ref(id, node), nodes[node].cost);
+					return;
+				}
+
+				if (shared.total_expanded.fetch_add(1, std::memory_order_relaxed) >= shared.options.max_expanded_nodes) {
+					shared.stop.store(true);
+					return;
+				}
+
+				auto parent = make_ref(id, node);
+				auto cost = nodes[node].cost;
+				successors.for_each_child(position, statistics, [&](Push push, std::uint32_t length, Cell player, const auto &compute_lower_bound) {
+					++statistics.generated_nodes;
+					auto hash = position.get_box_hash() ^ shared.board.player_key(player);
+					auto state = StateMessage{hash, parent, cost + length, 0, player, push.box, push.direction};
+
+					auto owner = shared.owner_of(hash);
+					if (owner == id) {
+						add_node(state, [&](Cell *destination) { position.store_sorted(destination); }, compute_lower_bound);
+						return;
+					}
+
+					//The sender has the parent's matching at hand, so it ships the bound along.
+					if (auto maybe_bound = compute_lower_bound()) {
+						state.lower_bound = *maybe_bound;
+						send(owner, state);
+					}
+				});
+			}
+
+			//States announced since the last receive count as well, they are on their way here.
+			void publish_frontier() {
+				auto priority = open.empty() ? empty_frontier : priority_of(open.top());
+				frontier.store(std::min(priority, announced.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+			}
+
+			//Returns false if there was nothing worth expanding.
+			[[nodiscard]] auto expand_some() -> bool {
+				auto lowest_estimate = shared.lowest_frontier() >> 32;
+				auto expanded_any = false;
+				for (auto i = size_t{}; i < expansions_per_round && !open.empty(); ++i) {
+					auto entry = open.top();
+					if (entry.estimate >= shared.incumbent.load(std::memory_order_relaxed)) {
+						//Everything left is at least as expensive as the known solution.
+						open = {};
+						break;
+					}
+					//Stay close to the globally best estimate, or a thread that got ahead fills its table with
+					//states a sequential search never looks at. Waiting on the single best one would hold up
+					//all threads but its owner.
+					if (entry.estimate > lowest_estimate + frontier_band) {
+						break;
+					}
+					open.pop();
+
+					auto &node = nodes[entry.node];
+					if (node.closed || node.cost != entry.cost) {
+						continue;
+					}
+					node.closed = true;
+					expanded_any = true;
+					expand(entry.node);
+				}
+				return expanded_any;
+			}
+
+		public:
+			MpscQueue<Batch> inbox;
+			//Priority of the best open state, read by the other threads.
+			alignas(64) std::atomic<std::uint64_t> frontier{empty_frontier};
+			//Best priority of the batches sent here since the last receive.
+			std::atomic<std::uint64_t> announced{empty_frontier};
+
+			Worker(This &_shared, size_t _id) :
+				shared{_shared},
+				id{_id},
+				position{_shared.board},
+				successors{_shared.board, _shared.options},
+				outgoing(_shared.number_of_threads)
+			{}
+
+			void add_root() {
+				auto player = successors.normalized_player(position);
+				auto hash = position.get_box_hash() ^ shared.board.player_key(player);
+				assert(shared.owner_of(hash) == id);
+				auto state = StateMessage{hash, no_parent, 0, 0, player, no_cell, Direction::Up};
+				add_node(state, [&](Cell *destination) { position.store_sorted(destination); }, [&]() {
+					return successors.lower_bound_of(position);
+				});
+			}
+
+			void run() {
+				auto start = std::chrono::steady_clock::now();
+
+				while (!shared.stop.load(std::memory_order_relaxed)) {
+					auto did_work = receive();
+					did_work = expand_some() || did_work;
+					flush_all();
+					publish_frontier();
+					if (did_work) {
+						continue;
+					}
+					if (!open.empty()) {
+						//Waiting for the others to catch up with our frontier.
+						++thread_statistics.waiting_rounds;
+						std::this_thread::yield();
+						continue;
+					}
+
+					if (!is_idle) {
+						is_idle = true;
+						shared.idle_workers.fetch_add(1);
+					}
+					++thread_statistics.idle_rounds;
+					if (shared.can_terminate()) {
+						shared.stop.store(true);
+						break;
+					}
+					std::this_thread::yield();
+				}
+
+				thread_statistics.expanded_nodes = statistics.expanded_nodes;
+				thread_statistics.generated_nodes = statistics.generated_nodes;
+				thread_statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				statistics.stored_states = nodes.size();
+			}
+
+			//Announces states on their way here before they are received.
+			void announce(std::uint64_t priority) {
+				for (auto *target : {&announced, &frontier}) {
+					auto current = target->load(std::memory_order_relaxed);
+					while (priority < current && !target->compare_exchange_weak(current, priority, std::memory_order_relaxed)) {}
+				}
+			}
+
+			[[nodiscard]] auto get_node(std::uint32_t node) const -> const Node & { return nodes[node]; }
+			[[nodiscard]] auto get_statistics() const -> const SolverStatistics & { return statistics; }
+
+			[[nodiscard]] auto get_thread_statistics() const -> ThreadStatistics {
+				auto result = thread_statistics;
+				result.contended_pushes = inbox.get_contended_pushes();
+				return result;
+			}
+		};
+
+		const Board &board;
+		SolverOptions options;
+		size_t number_of_threads;
+		size_t number_of_boxes;
+
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		std::atomic<size_t> in_flight{0};
+		std::atomic<size_t> idle_workers{0};
+		std::atomic<size_t> epoch{0};
+		std::atomic<size_t> total_expanded{0};
+		std::atomic<bool> stop{false};
+
+		std::atomic<std::uint32_t> incumbent{std::numeric_limits<std::uint32_t>::max()};
+		std::mutex solution_mutex;
+		NodeRef solution_node = no_parent;
+
+		[[nodiscard]] auto owner_of(std::uint64_t hash) const -> size_t {
+			//The low bits pick table slots, the high ones pick the owner.
+			return (hash >> 40) % number_of_threads;
+		}
+
+		[[nodiscard]] auto lowest_frontier() const -> std::uint64_t {
+			auto lowest = empty_frontier;
+			for (const auto &worker : workers) {
+				stdc::minimize(lowest, worker->frontier.load(std::memory_order_relaxed));
+			}
+			return lowest;
+		}
+
+		void report_solution(NodeRef node, std::uint32_t cost) {
+			auto lock = std::lock_guard{solution_mutex};
+			if (cost < incumbent.load()) {
+				incumbent.store(cost);
+				solution_node = node;
+			}
+		}
+
+		//Everybody idle and nothing in flight. The epoch makes sure nobody woke up while we were looking: a worker
+		//bumps it before it leaves the idle state, which it can only do by receiving states, and again once they are
+		//in its open list, before it takes them out of in_flight.
+		[[nodiscard]] auto can_terminate() const -> bool {
+			auto before = epoch.load();
+			if (idle_workers.load() != number_of_threads || in_flight.load() != 0) {
+				return false;
+			}
+			return epoch.load() == before;
+		}
+
+		[[nodiscard]] auto reconstruct() const -> std::optional<std::string> {
+			auto pushes = std::vector<Push>{};
+			for (auto ref = solution_node; ; ) {
+				const auto &node = workers[ref >> 32]->get_node(static_cast<std::uint32_t>(ref));
+				if (node.parent == no_parent) {
+					break;
+				}
+				pushes.push_back(Push{node.pushed_box, node.direction});
+				ref = node.parent;
+			}
+			std::reverse(RANGE(pushes));
+			return pushes_to_lurd(board, SuccessorGenerator{board, options}.expand_macros(pushes));
+		}
+
+	public:
+		ParallelSolver(const Board &_board, SolverOptions _options, size_t _number_of_threads) :
+			board{_board},
+			options{_options},
+			number_of_threads{std::max(_number_of_threads, size_t{1})},
+			number_of_boxes{_board.get_initial_boxes().size()}
+		{
+			for (auto id = size_t{}; id < number_of_threads; ++id) {
+				workers.push_back(std::make_unique<Worker>(*this, id));
+			}
+		}
+
+		ParallelSolver(const This &) = delete;
+		auto operator=(const This &) & -> ParallelSolver & = delete;
+		ParallelSolver(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> ParallelSolver & = delete;
+		~ParallelSolver() = default;
+
+		[[nodiscard]] auto run() -> ParallelSolverResult {
+			auto start = std::chrono::steady_clock::now();
+
+			{
+				auto position = Position{board};
+				auto probe = SuccessorGenerator{board, options};
+				auto hash = position.get_box_hash() ^ board.player_key(probe.normalized_player(position));
+				workers[owner_of(hash)]->add_root();
+			}
+
+			{
+				auto threads = std::vector<std::jthread>{};
+				for (auto &worker : workers) {
+					threads.emplace_back([&worker]() { worker->run(); });
+				}
+			}
+
+			auto result = ParallelSolverResult{};
+			auto &statistics = result.result.statistics;
+			for (const auto &worker : workers) {
+				const auto &worker_statistics = worker->get_statistics();
+				statistics.expanded_nodes += worker_statistics.expanded_nodes;
+				statistics.generated_nodes += worker_statistics.generated_nodes;
+				statistics.stored_states += worker_statistics.stored_states;
+				statistics.corral_prunings += worker_statistics.corral_prunings;
+				result.threads.push_back(worker->get_thread_statistics());
+			}
+
+			if (solution_node != no_parent) {
+				result.result.solution = reconstruct();
+			} else {
+				result.result.proven_unsolvable = total_expanded.load() < options.max_expanded_nodes && !options.use_macros;
+			}
+
+			statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			return result;
+		}
+	};
+
+	[[nodiscard]] inline auto solve_in_parallel(Level level, SolverOptions options, size_t number_of_threads) -> ParallelSolverResult {
+		auto board = Board{level};
+		return ParallelSolver{board, options, number_of_threads}.run();
+	}
+
+} //namespace sstm
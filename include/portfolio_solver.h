@@ -0,0 +1,147 @@
+#pragma once
+
+#include "board.h"
+#include "bidirectional_solver.h"
+#include "sokoban_parser.h"
+#include "solver.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace sstm {
+
+	enum class Strategy : std::uint8_t {
+		//Weighted A*, quick to find some solution but not a short one.
+		Greedy,
+		//Push-optimal A* without macros.
+		AStar,
+		Bidirectional,
+		//A* with tunnel and goal-room macros, which may cost push-optimality.
+		Macros,
+	};
+
+	inline constexpr auto all_strategies = std::array{Strategy::Greedy, Strategy::AStar, Strategy::Bidirectional, Strategy::Macros};
+
+	[[nodiscard]] constexpr auto to_string(Strategy strategy) -> std::string_view {
+		switch (strategy) {
+		case Strategy::Greedy:
+			return "greedy";
+		case Strategy::AStar:
+			return "A*";
+		case Strategy::Bidirectional:
+			return "bidirectional";
+		case Strategy::Macros:
+			return "macros";
+		}
+		return "";
+	}
+
+	//Whether the strategy only finds push-optimal solutions.
+	[[nodiscard]] constexpr auto is_push_optimal(Strategy strategy) -> bool {
+		return strategy == Strategy::AStar || strategy == Strategy::Bidirectional;
+	}
+
+	//Whether running out of states proves the level unsolvable. The macro strategies never leave a box part-way
+	//down a tunnel and fill goal rooms in one order, so they can run out on a solvable level.
+	[[nodiscard]] constexpr auto can_prove_unsolvable(Strategy strategy) -> bool {
+		return strategy == Strategy::AStar || strategy == Strategy::Bidirectional;
+	}
+
+	struct PortfolioResult {
+		SolverResult result;
+		//The strategy that solved the level or proved it unsolvable, if any did.
+		std::optional<Strategy> maybe_winner;
+	};
+
+	[[nodiscard]] inline auto run_strategy(const Board &board, SolverOptions options, Strategy strategy) -> SolverResult {
+		switch (strategy) {
+		case Strategy::Greedy:
+			options.weight = 3;
+			options.use_macros = true;
+			return Solver{board, options}.run();
+		case Strategy::AStar:
+			options.use_macros = false;
+			return Solver{board, options}.run();
+		case Strategy::Bidirectional:
+			return BidirectionalSolver{board, options}.run();
+		case Strategy::Macros:
+			options.use_macros = true;
+			return Solver{board, options}.run();
+		}
+		return {};
+	}
+
+	//Races the strategies on one thread each. The first to solve the level or prove it unsolvable wins and the rest
+	//are stopped, as are all of them once options.maybe_time_limit is up, so a level takes at most about that long.
+	//Only the strategies without macros can prove a level unsolvable, see can_prove_unsolvable.
+	//Throws std::invalid_argument if the level is malformed.
+	[[nodiscard]] inline auto solve_portfolio(Level level, SolverOptions options = {}, std::span<const Strategy> strategies = all_strategies) -> PortfolioResult {
+		auto start = std::chrono::steady_clock::now();
+		auto board = Board{level};
+
+		//The racers share the memory limit, the bidirectional one does not keep to it.
+		if (options.maybe_memory_limit) {
+			*options.maybe_memory_limit /= std::max(strategies.size(), size_t{1});
+		}
+
+		auto stop_source = std::stop_source{};
+		auto parent_stop_callback = std::stop_callback{options.stop_token, [&]() { stop_source.request_stop(); }};
+		options.stop_token = stop_source.get_token();
+
+		auto mutex = std::mutex{};
+		auto has_finished = std::condition_variable{};
+		auto number_of_running = strategies.size();
+		auto result = PortfolioResult{};
+		auto statistics = SolverStatistics{};
+
+		{
+			auto threads = std::vector<std::jthread>{};
+			for (auto strategy : strategies) {
+				threads.emplace_back([&, strategy]() {
+					auto strategy_result = run_strategy(board, options, strategy);
+					auto lock = std::lock_guard{mutex};
+					--number_of_running;
+					statistics.expanded_nodes += strategy_result.statistics.expanded_nodes;
+					statistics.generated_nodes += strategy_result.statistics.generated_nodes;
+					statistics.stored_states += strategy_result.statistics.stored_states;
+					statistics.corral_prunings += strategy_result.statistics.corral_prunings;
+					if (!can_prove_unsolvable(strategy)) {
+						strategy_result.proven_unsolvable = false;
+					}
+					if (!result.maybe_winner && (strategy_result.solution || strategy_result.proven_unsolvable)) {
+						result.result = std::move(strategy_result);
+						result.maybe_winner = strategy;
+						stop_source.request_stop();
+					}
+					has_finished.notify_one();
+				});
+			}
+
+			auto lock = std::unique_lock{mutex};
+			auto is_done = [&]() { return result.maybe_winner || number_of_running == 0; };
+			if (options.maybe_time_limit) {
+				has_finished.wait_until(lock, start + *options.maybe_time_limit, is_done);
+			} else {
+				has_finished.wait(lock, is_done);
+			}
+			lock.unlock();
+			stop_source.request_stop();
+		}
+
+		//The nodes of the strategies that lost count too, they took their share of the time.
+		result.result.statistics = statistics;
+		result.result.statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return result;
+	}
+
+} //namespace sstm
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "board.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace sstm {
+
+	//One box push, identified by where the box stood before it.
+	struct Push {
+		Cell box;
+		Direction direction;
+	};
+
+	//A mutable box configuration on a Board, with an incrementally updated Zobrist hash.
+	//Search code loads a stored state into it, tries pushes and takes them back.
+	class Position {
+	private:
+		const Board *board = nullptr;
+		std::vector<Cell> boxes;
+		std::vector<std::uint8_t> occupied;
+		//The same as bitboards, if the board has them.
+		std::vector<std::uint64_t> box_rows;
+		std::uint64_t box_hash = 0;
+		size_t boxes_on_goals = 0;
+
+	public:
+		Cell player = no_cell;
+
+		Position() = default;
+
+		explicit Position(const Board &_board) :
+			board{&_board},
+			occupied(_board.number_of_cells()),
+			box_rows(_board.get_floor_rows().size())
+		{
+			load(board->get_initial_boxes(), board->get_initial_player());
+		}
+
+		void load(const Cell *first_box, size_t number_of_boxes, Cell _player) {
+			for (auto box : boxes) {
+				occupied[box] = 0;
+			}
+			std::fill(RANGE(box_rows), std::uint64_t{});
+			boxes.assign(first_box, first_box + number_of_boxes);
+			box_hash = 0;
+			boxes_on_goals = 0;
+			for (auto box : boxes) {
+				occupied[box] = 1;
+				if (board->has_bitboards()) {
+					box_rows[board->bitboard_row(box)] |= board->bitboard_mask(box);
+				}
+				box_hash ^= board->box_key(box);
+				boxes_on_goals += board->is_goal(box);
+			}
+			player = _player;
+		}
+
+		void load(const std::vector<Cell> &_boxes, Cell _player) {
+			load(_boxes.data(), _boxes.size(), _player);
+		}
+
+		[[nodiscard]] auto get_board() const -> const Board & { return *board; }
+		[[nodiscard]] auto get_boxes() const -> const auto & { return boxes; }
+		[[nodiscard]] auto get_occupied() const -> const auto & { return occupied; }
+		[[nodiscard]] auto get_box_rows() const -> const auto & { return box_rows; }
+		[[nodiscard]] auto get_box_hash() const { return box_hash; }
+		[[nodiscard]] auto is_box(Cell cell) const -> bool { return occupied[cell]; }
+		[[nodiscard]] auto is_solved() const { return boxes_on_goals == boxes.size(); }
+
+		[[nodiscard]] auto is_free(Cell cell) const -> bool {
+			return !board->is_wall(cell) && !occupied[cell];
+		}
+
+		[[nodiscard]] auto index_of(Cell box) const -> size_t {
+			auto it = std::find(RANGE(boxes), box);
+			assert(it != boxes.end());
+			return static_cast<size_t>(it - boxes.begin());
+		}
+
+		//Moves the box with the given index, without any legality checks.
+		void move_box(size_t index, Cell to) {
+			auto from = boxes[index];
+			assert(occupied[from] && !occupied[to]);
+			occupied[from] = 0;
+			occupied[to] = 1;
+			if (board->has_bitboards()) {
+				box_rows[board->bitboard_row(from)] ^= board->bitboard_mask(from);
+				box_rows[board->bitboard_row(to)] ^= board->bitboard_mask(to);
+			}
+			box_hash ^= board->box_key(from) ^ board->box_key(to);
+			boxes_on_goals = boxes_on_goals - board->is_goal(from) + board->is_goal(to);
+			boxes[index] = to;
+		}
+
+		//Copies the boxes in ascending order, the canonical form states are stored in.
+		void store_sorted(Cell *destination) const {
+			std::copy(RANGE(boxes), destination);
+			std::sort(destination, destination + boxes.size());
+		}
+	};
+
+} //namespace sstm
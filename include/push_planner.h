@@ -0,0 +1,126 @@
+#pragma once
+
+#include "board.h"
+#include "reachability.h"
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//Moves one box to a chosen cell while the other boxes stay where they are: the fewest pushes, and among those the
+	//fewest moves. A state is the cell of the box and the direction of the last push, which fixes where the player
+	//stands; between pushes the player walks around the box, found by a breadth-first search per state.
+	//`occupied` marks the other boxes. Returns the moves in LURD notation, or nullopt if the box cannot get there.
+	[[nodiscard]] inline auto plan_box_path(const Board &board, std::vector<std::uint8_t> occupied, Cell player, Cell box, Cell target) -> std::optional<std::string> {
+		assert(!occupied[box] && !occupied[player]);
+		if (box == target) {
+			return std::string{};
+		}
+		if (board.is_wall(target) || occupied[target]) {
+			return std::nullopt;
+		}
+
+		//Pushes first, moves second.
+		using Cost = std::uint64_t;
+		constexpr auto push_cost = Cost{1} << 32;
+		constexpr auto unreached = std::numeric_limits<Cost>::max();
+		constexpr auto no_state = std::numeric_limits<std::uint32_t>::max();
+
+		auto to_state = [](Cell cell, Direction direction) { return std::uint32_t{cell} * 4 + static_cast<std::uint32_t>(direction); };
+		auto costs = std::vector<Cost>(board.number_of_cells() * 4, unreached);
+		auto parents = std::vector<std::uint32_t>(board.number_of_cells() * 4, no_state);
+		auto open = std::priority_queue<std::pair<Cost, std::uint32_t>, std::vector<std::pair<Cost, std::uint32_t>>, std::greater<>>{};
+
+		//Boxes cannot leave dead squares towards any goal, so neither towards a target that is not dead itself.
+		auto may_enter = [&](Cell cell) {
+			return !board.is_wall(cell) && !occupied[cell] && (cell == target || board.is_dead_square(target) || !board.is_dead_square(cell));
+		};
+
+		auto distances = std::vector<std::uint32_t>(board.number_of_cells());
+		auto stamps = std::vector<std::uint32_t>(board.number_of_cells());
+		auto generation = std::uint32_t{};
+		auto queue = std::vector<Cell>{};
+
+		//Walks from `from` with the box at `at`, then pushes it every way it can go.
+		auto expand = [&](Cell at, Cell from, Cost cost, std::uint32_t parent) {
+			++generation;
+			stamps[from] = generation;
+			distances[from] = 0;
+			queue.assign(1, from);
+			occupied[at] = 1;
+			for (auto i = size_t{}; i < queue.size(); ++i) {
+				auto cell = queue[i];
+				for (auto direction : all_directions) {
+					auto next = board.neighbor(cell, direction);
+					if (stamps[next] == generation || board.is_wall(next) || occupied[next]) {
+						continue;
+					}
+					stamps[next] = generation;
+					distances[next] = distances[cell] + 1;
+					queue.push_back(next);
+				}
+			}
+			occupied[at] = 0;
+
+			for (auto direction : all_directions) {
+				auto stand = board.neighbor(at, opposite(direction));
+				auto next = board.neighbor(at, direction);
+				if (stamps[stand] != generation || !may_enter(next)) {
+					continue;
+				}
+				auto next_cost = cost + push_cost + distances[stand] + 1;
+				auto state = to_state(next, direction);
+				if (next_cost < costs[state]) {
+					costs[state] = next_cost;
+					parents[state] = parent;
+					open.emplace(next_cost, state);
+				}
+			}
+		};
+
+		expand(box, player, 0, no_state);
+		while (!open.empty()) {
+			auto [cost, state] = open.top();
+			open.pop();
+			if (cost != costs[state]) {
+				continue;
+			}
+
+			auto at = static_cast<Cell>(state / 4);
+			auto direction = static_cast<Direction>(state % 4);
+			if (at != target) {
+				expand(at, board.neighbor(at, opposite(direction)), cost, state);
+				continue;
+			}
+
+			auto pushes = std::vector<Push>{};
+			for (auto back = state; back != no_state; back = parents[back]) {
+				auto pushed = static_cast<Direction>(back % 4);
+				pushes.push_back(Push{board.neighbor(static_cast<Cell>(back / 4), opposite(pushed)), pushed});
+			}
+
+			auto lurd = std::string{};
+			for (auto it = pushes.rbegin(); it != pushes.rend(); ++it) {
+				occupied[it->box] = 1;
+				auto maybe_walk = find_player_path(board, occupied, player, board.neighbor(it->box, opposite(it->direction)));
+				occupied[it->box] = 0;
+				assert(maybe_walk);
+				lurd += *maybe_walk;
+				lurd.push_back(to_lurd(it->direction, true));
+				player = it->box;
+			}
+			return lurd;
+		}
+
+		return std::nullopt;
+	}
+
+} //namespace sstm
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+
+#include <cool/algorithm.h>
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//The region the player can walk to without pushing, plus its canonical representative.
+	//On boards with bitboards the region grows a whole row at a time; otherwise a flood fill with
+	//generation stamps makes repeated fills on the same Board allocation free.
+	class Reachability {
+	private:
+		std::vector<std::uint32_t> stamps;
+		std::uint32_t generation = 0;
+		std::vector<Cell> stack;
+		Cell top_left = no_cell;
+
+		const Board *bitboard_owner = nullptr;
+		std::vector<std::uint64_t> free_rows;
+		std::vector<std::uint64_t> reached_rows;
+
+		//Spreads the seeds through the free cells of one row. Towards higher columns the carries of free + seeds
+		//run exactly through the free cells above each seed; the other way takes log2(64) shifts.
+		[[nodiscard]] static auto fill_row(std::uint64_t seeds, std::uint64_t free) -> std::uint64_t {
+			auto up = (((free + seeds) ^ free ^ seeds) & free) | seeds;
+			auto down = seeds;
+			for (auto shift = 1u; shift < 64; shift *= 2) {
+				down |= free & (down >> shift);
+				free &= free >> shift;
+			}
+			return up | down;
+		}
+
+		//Takes in the cells of the rows above and below. Returns whether the row grew.
+		auto grow_row(size_t row) -> bool {
+			auto seeds = (reached_rows[row - 1] | reached_rows[row + 1]) & free_rows[row] & ~reached_rows[row];
+			if (!seeds) {
+				return false;
+			}
+			reached_rows[row] |= fill_row(seeds, free_rows[row]);
+			return true;
+		}
+
+	public:
+		//occupied[cell] is non-zero for boxes.
+		void compute(const Board &board, const std::vector<std::uint8_t> &occupied, Cell from) {
+			assert(!board.is_wall(from) && !occupied[from]);
+			bitboard_owner = nullptr;
+
+			if (stamps.size() != board.number_of_cells()) {
+				stamps.assign(board.number_of_cells(), 0);
+				generation = 0;
+			}
+			++generation;
+			if (!generation) {
+				std::fill(RANGE(stamps), 0);
+				generation = 1;
+			}
+
+			top_left = from;
+			stamps[from] = generation;
+			stack.clear();
+			stack.push_back(from);
+			while (!stack.empty()) {
+				auto cell = stack.back();
+				stack.pop_back();
+				for (auto direction : all_directions) {
+					auto next = board.neighbor(cell, direction);
+					if (stamps[next] != generation && !board.is_wall(next) && !occupied[next]) {
+						stamps[next] = generation;
+						stack.push_back(next);
+						stdc::minimize(top_left, next);
+					}
+				}
+			}
+		}
+
+		void compute(const Position &position, Cell from) {
+			const auto &board = position.get_board();
+			if (!board.has_bitboards()) {
+				compute(board, position.get_occupied(), from);
+				return;
+			}
+			assert(position.is_free(from));
+			bitboard_owner = &board;
+
+			const auto &floor_rows = board.get_floor_rows();
+			const auto &box_rows = position.get_box_rows();
+			auto height = floor_rows.size();
+			free_rows.resize(height);
+			reached_rows.assign(height, 0);
+			for (auto row = size_t{}; row < height; ++row) {
+				free_rows[row] = floor_rows[row] & ~box_rows[row];
+			}
+
+			auto from_row = board.bitboard_row(from);
+			reached_rows[from_row] = fill_row(board.bitboard_mask(from), free_rows[from_row]);
+
+			//The first and last rows are padding walls. Sweeping down and back up covers any region that
+			//does not wind up and down, the others take one more round trip per turn.
+			for (auto has_grown = true; has_grown;) {
+				has_grown = false;
+				for (auto row = size_t{1}; row + 1 < height; ++row) {
+					has_grown |= grow_row(row);
+				}
+				for (auto row = height - 2; row > 0; --row) {
+					has_grown |= grow_row(row);
+				}
+			}
+
+			auto row = size_t{};
+			while (!reached_rows[row]) {
+				++row;
+			}
+			top_left = static_cast<Cell>(row * board.get_width() + static_cast<size_t>(std::countr_zero(reached_rows[row])));
+		}
+
+		[[nodiscard]] auto contains(Cell cell) const -> bool {
+			if (bitboard_owner) {
+				return reached_rows[bitboard_owner->bitboard_row(cell)] & bitboard_owner->bitboard_mask(cell);
+			}
+			return stamps[cell] == generation;
+		}
+
+		//Cells are numbered row by row, so the smallest one is the top-left of the region.
+		[[nodiscard]] auto normalized() const -> Cell {
+			return top_left;
+		}
+	};
+
+	//Cells whose removal splits the floor, by an iterative Tarjan depth-first search.
+	[[nodiscard]] inline auto find_articulation_points(const Board &board) -> std::vector<std::uint8_t> {
+		auto n = board.number_of_cells();
+		auto discovery = std::vector<std::uint32_t>(n);
+		auto low = std::vector<std::uint32_t>(n);
+		auto parent = std::vector<Cell>(n, no_cell);
+		auto is_articulation = std::vector<std::uint8_t>(n);
+
+		auto root = board.get_initial_player();
+		auto root_children = size_t{};
+		auto timer = std::uint32_t{1};
+		discovery[root] = low[root] = timer++;
+
+		//Cells on the DFS path with the next direction to try.
+		auto stack = std::vector<std::pair<Cell, size_t>>{{root, 0}};
+		while (!stack.empty()) {
+			auto [cell, next] = stack.back();
+			if (next < all_directions.size()) {
+				++stack.back().second;
+				auto neighbor = board.neighbor(cell, all_directions[next]);
+				if (board.is_wall(neighbor)) {
+					continue;
+				}
+				if (!discovery[neighbor]) {
+					parent[neighbor] = cell;
+					discovery[neighbor] = low[neighbor] = timer++;
+					stack.emplace_back(neighbor, 0);
+					root_children += cell == root;
+				} else if (neighbor != parent[cell]) {
+					stdc::minimize(low[cell], discovery[neighbor]);
+				}
+				continue;
+			}
+
+			stack.pop_back();
+			if (auto up = parent[cell]; up != no_cell) {
+				stdc::minimize(low[up], low[cell]);
+				if (up != root && low[cell] >= discovery[up]) {
+					is_articulation[up] = 1;
+				}
+			}
+		}
+		is_articulation[root] = root_children > 1;
+		return is_articulation;
+	}
+
+	//Shortest walk from one cell to another in LURD lower case, or nullopt if there is none.
+	[[nodiscard]] inline auto find_player_path(const Board &board, const std::vector<std::uint8_t> &occupied, Cell from, Cell to) -> std::optional<std::string> {
+		if (from == to) {
+			return std::string{};
+		}
+
+		auto came_from = std::vector<Direction>(board.number_of_cells());
+		auto visited = std::vector<std::uint8_t>(board.number_of_cells());
+		auto queue = std::vector<Cell>{from};
+		visited[from] = 1;
+
+		for (auto i = size_t{}; i < queue.size(); ++i) {
+			auto cell = queue[i];
+			for (auto direction : all_directions) {
+				auto next = board.neighbor(cell, direction);
+				if (visited[next] || board.is_wall(next) || occupied[next]) {
+					continue;
+				}
+				visited[next] = 1;
+				came_from[next] = direction;
+
+				if (next == to) {
+					auto path = std::string{};
+					for (auto back = next; back != from; back = board.neighbor(back, opposite(came_from[back]))) {
+						path.push_back(to_lurd(came_from[back], false));
+					}
+					return std::string{path.rbegin(), path.rend()};
+				}
+				queue.push_back(next);
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	//Replays pushes from the initial state of the board and fills in the walks between them.
+	[[nodiscard]] inline auto pushes_to_lurd(const Board &board, const std::vector<Push> &pushes) -> std::optional<std::string> {
+		auto position = Position{board};
+		auto lurd = std::string{};
+
+		for (const auto &push : pushes) {
+			auto index = position.index_of(push.box);
+			auto stand = board.neighbor(push.box, opposite(push.direction));
+			auto maybe_walk = find_player_path(board, position.get_occupied(), position.player, stand);
+			if (!maybe_walk) {
+				return std::nullopt;
+			}
+			lurd += *maybe_walk;
+			lurd.push_back(to_lurd(push.direction, true));
+
+			position.move_box(index, board.neighbor(push.box, push.direction));
+			position.player = push.box;
+		}
+
+		return lurd;
+	}
+
+	//Replays a LURD string from the initial state of the board. Returns its pushes, or nullopt if a move
+	//is illegal or the level is not solved at the end.
+	[[nodiscard]] inline auto lurd_to_pushes(const Board &board, std::string_view lurd) -> std::optional<std::vector<Push>> {
+		auto position = Position{board};
+		auto pushes = std::vector<Push>{};
+
+		for (auto c : lurd) {
+			auto maybe_direction = from_lurd(c);
+			if (!maybe_direction) {
+				return std::nullopt;
+			}
+			auto next = board.neighbor(position.player, *maybe_direction);
+			auto is_push = 'A' <= c && c <= 'Z';
+			if (board.is_wall(next) || is_push != position.is_box(next)) {
+				return std::nullopt;
+			}
+			if (is_push) {
+				auto target = board.neighbor(next, *maybe_direction);
+				if (!position.is_free(target)) {
+					return std::nullopt;
+				}
+				position.move_box(position.index_of(next), target);
+				pushes.push_back(Push{next, *maybe_direction});
+			}
+			position.player = next;
+		}
+
+		if (!position.is_solved()) {
+			return std::nullopt;
+		}
+		return pushes;
+	}
+
+} //namespace sstm
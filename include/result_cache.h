@@ -0,0 +1,536 @@
+#pragma once
+
+#include "board.h"
+#include "mapped_file.h"
+#include "position.h"
+#include "reachability.h"
+#include "sokoban_parser.h"
+#include "solver.h"
+
+#include <cool/filesystem.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//A level up to the eight symmetries of the square and the player's cell within the region it can walk, so
+	//the same level under another name, turned or mirrored, has the same key. The key is the cropped grid with
+	//the smallest bytes over all symmetries: its height and width, each cell as floor | goal << 1 | box << 2
+	//row by row, and the first cell of the player's region.
+	class CanonicalLevel {
+	public:
+		static constexpr auto no_cell = std::numeric_limits<std::uint32_t>::max();
+
+	private:
+		const Board *board;
+		std::vector<std::uint8_t> key;
+		std::uint64_t hash = 14695981039346656037u;
+		size_t width = 0;
+		//The board cell of each canonical cell, and the other way round.
+		std::vector<Cell> board_cells;
+		std::vector<std::uint32_t> canonical_cells;
+
+	public:
+		explicit CanonicalLevel(const Board &_board) :
+			board{&_board},
+			canonical_cells(_board.number_of_cells(), no_cell)
+		{
+			auto n = board->number_of_cells();
+			auto codes = std::vector<std::uint8_t>(n);
+			for (auto cell = Cell{}; cell < n; ++cell) {
+				codes[cell] = static_cast<std::uint8_t>((board->is_wall(cell) ? 0 : 1) | (board->is_goal(cell) ? 2 : 0));
+			}
+			auto occupied = std::vector<std::uint8_t>(n);
+			for (auto box : board->get_initial_boxes()) {
+				codes[box] |= 4;
+				occupied[box] = 1;
+			}
+
+			auto region = std::vector<std::uint8_t>(n);
+			auto stack = std::vector<Cell>{board->get_initial_player()};
+			region[stack.back()] = 1;
+			while (!stack.empty()) {
+				auto cell = stack.back();
+				stack.pop_back();
+				for (auto direction : all_directions) {
+					auto next = board->neighbor(cell, direction);
+					if (!region[next] && !board->is_wall(next) && !occupied[next]) {
+						region[next] = 1;
+						stack.push_back(next);
+					}
+				}
+			}
+
+			auto board_width = board->get_width();
+			auto top = n, bottom = size_t{}, left = board_width, right = size_t{};
+			for (auto cell = size_t{}; cell < n; ++cell) {
+				if (codes[cell]) {
+					top = std::min(top, cell / board_width);
+					bottom = std::max(bottom, cell / board_width);
+					left = std::min(left, cell % board_width);
+					right = std::max(right, cell % board_width);
+				}
+			}
+			auto height = bottom - top + 1;
+			auto cropped_width = right - left + 1;
+
+			auto candidate = std::vector<std::uint8_t>{};
+			auto candidate_cells = std::vector<Cell>{};
+			for (auto symmetry = 0u; symmetry < 8; ++symmetry) {
+				auto is_transposed = (symmetry & 4) != 0;
+				auto rows = is_transposed ? cropped_width : height;
+				auto columns = is_transposed ? height : cropped_width;
+
+				candidate.assign({
+					static_cast<std::uint8_t>(rows), static_cast<std::uint8_t>(rows >> 8),
+					static_cast<std::uint8_t>(columns), static_cast<std::uint8_t>(columns >> 8),
+				});
+				candidate_cells.clear();
+				auto maybe_player = std::optional<size_t>{};
+				for (auto r = size_t{}; r < rows; ++r) {
+					for (auto c = size_t{}; c < columns; ++c) {
+						auto [row, column] = is_transposed ? std::pair{c, r} : std::pair{r, c};
+						if (symmetry & 1) {
+							row = height - 1 - row;
+						}
+						if (symmetry & 2) {
+							column = cropped_width - 1 - column;
+						}
+						auto cell = static_cast<Cell>((top + row) * board_width + left + column);
+						if (region[cell] && !maybe_player) {
+							maybe_player = candidate_cells.size();
+						}
+						candidate.push_back(codes[cell]);
+						candidate_cells.push_back(cell);
+					}
+				}
+				candidate.push_back(static_cast<std::uint8_t>(*maybe_player));
+				candidate.push_back(static_cast<std::uint8_t>(*maybe_player >> 8));
+
+				if (key.empty() || candidate < key) {
+					std::swap(key, candidate);
+					std::swap(board_cells, candidate_cells);
+					width = columns;
+				}
+			}
+
+			for (auto index = size_t{}; index < board_cells.size(); ++index) {
+				canonical_cells[board_cells[index]] = static_cast<std::uint32_t>(index);
+			}
+			for (auto byte : key) {
+				hash = (hash ^ byte) * 1099511628211u;
+			}
+		}
+
+		[[nodiscard]] auto get_key() const -> const auto & { return key; }
+		[[nodiscard]] auto get_hash() const { return hash; }
+
+		//A push as its box's canonical cell times four plus the canonical direction.
+		[[nodiscard]] auto to_canonical(Push push) const -> std::uint32_t {
+			auto from = canonical_cells[push.box];
+			auto to = canonical_cells[board->neighbor(push.box, push.direction)];
+			auto direction = to + width == from ? Direction::Up : to == from + width ? Direction::Down : to + 1 == from ? Direction::Left : Direction::Right;
+			return from << 2 | static_cast<std::uint32_t>(direction);
+		}
+
+		//nullopt if the push leaves the grid, which only a record of another level can ask for.
+		[[nodiscard]] auto to_board(std::uint32_t push) const -> std::optional<Push> {
+			auto from = size_t{push >> 2};
+			auto offsets = std::array{-static_cast<std::ptrdiff_t>(width), static_cast<std::ptrdiff_t>(width), std::ptrdiff_t{-1}, std::ptrdiff_t{1}};
+			auto to = static_cast<size_t>(static_cast<std::ptrdiff_t>(from) + offsets[push & 3]);
+			if (from >= board_cells.size() || to >= board_cells.size()) {
+				return std::nullopt;
+			}
+			for (auto direction : all_directions) {
+				if (board->neighbor(board_cells[from], direction) == board_cells[to]) {
+					return Push{board_cells[from], direction};
+				}
+			}
+			return std::nullopt;
+		}
+	};
+
+	//Solutions and unsolvability proofs of every level solved so far, by canonical level. Results are appended to
+	//a record file as they come in; save() writes an open addressing index of the records, which is mapped into
+	//memory, so a lookup is one probe sequence whatever the size of the cache. Records the index does not cover
+	//yet are kept in memory. A solution remembers whether the search that found it promised push-optimality, and
+	//a better result for a level supersedes the one before, newer records winning. find may run on several
+	//threads at once, add and save on one.
+	class ResultCache {
+	private:
+		using This = ResultCache;
+
+		static constexpr auto magic = std::uint64_t{0x5844'4e49'5453'5353}; //"SSTSINDX"
+		static constexpr auto records_magic = std::uint64_t{0x544c'5352'5453'5353}; //"SSTSRSLT"
+		static constexpr auto version = std::uint32_t{2};
+		static constexpr auto empty = std::numeric_limits<std::uint64_t>::max();
+
+		struct RecordsHeader {
+			std::uint64_t magic;
+			std::uint32_t version;
+			std::uint32_t unused;
+		};
+
+		struct IndexHeader {
+			std::uint64_t magic;
+			std::uint32_t version;
+			std::uint32_t unused;
+			//Bytes of the record file the index covers.
+			std::uint64_t records_size;
+			//A power of two.
+			std::uint64_t number_of_slots;
+		};
+
+		struct Slot {
+			std::uint64_t hash;
+			std::uint64_t offset;
+		};
+
+		struct Record {
+			std::vector<std::uint8_t> key;
+			bool is_solved = false;
+			//Meaningless for proofs, which hold whatever found them.
+			bool is_optimal = false;
+			std::vector<std::uint32_t> pushes;
+
+			//Whether this record should answer in place of `other`, a record of the same level. Solutions are checked
+			//before they are added, so one that contradicts a proof shows the proof wrong.
+			[[nodiscard]] auto is_better_than(const Record &other) const -> bool {
+				if (!is_solved) {
+					return false;
+				}
+				if (!other.is_solved) {
+					return true;
+				}
+				if (is_optimal != other.is_optimal) {
+					return is_optimal;
+				}
+				return pushes.size() < other.pushes.size();
+			}
+		};
+
+		stdc::fs::path records_path;
+		stdc::fs::path index_path;
+		std::optional<MappedFile> maybe_records;
+		std::optional<MappedFile> maybe_index;
+		size_t records_size = 0;
+		std::unordered_multimap<std::uint64_t, std::pair<std::uint64_t, Record>> unindexed;
+
+		template<typename T>
+		[[nodiscard]] static auto read(std::span<const std::byte> bytes, size_t &offset) -> std::optional<T> {
+			static_assert(std::is_trivially_copyable_v<T>);
+			if (bytes.size() - offset < sizeof(T)) {
+				return std::nullopt;
+			}
+			auto value = T{};
+			std::memcpy(&value, bytes.data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return value;
+		}
+
+		//A record is its level's hash, key size, key, 1 if solved and 0 if unsolvable, 1 if push-optimal, number of
+		//pushes and pushes. nullopt at a truncated record, which a job killed while appending leaves behind.
+		[[nodiscard]] static auto read_record(std::span<const std::byte> bytes, size_t &offset) -> std::optional<std::pair<std::uint64_t, Record>> {
+			auto maybe_hash = read<std::uint64_t>(bytes, offset);
+			auto maybe_key_size = read<std::uint32_t>(bytes, offset);
+			if (!maybe_key_size || bytes.size() - offset < *maybe_key_size) {
+				return std::nullopt;
+			}
+			auto record = Record{};
+			record.key.resize(*maybe_key_size);
+			std::memcpy(record.key.data(), bytes.data() + offset, record.key.size());
+			offset += record.key.size();
+
+			auto maybe_is_solved = read<std::uint8_t>(bytes, offset);
+			auto maybe_is_optimal = read<std::uint8_t>(bytes, offset);
+			auto maybe_number_of_pushes = read<std::uint32_t>(bytes, offset);
+			if (!maybe_number_of_pushes || (bytes.size() - offset) / sizeof(std::uint32_t) < *maybe_number_of_pushes) {
+				return std::nullopt;
+			}
+			record.is_solved = *maybe_is_solved != 0;
+			record.is_optimal = *maybe_is_optimal != 0;
+			record.pushes.resize(*maybe_number_of_pushes);
+			std::memcpy(record.pushes.data(), bytes.data() + offset, record.pushes.size() * sizeof(std::uint32_t));
+			offset += record.pushes.size() * sizeof(std::uint32_t);
+			return std::pair{*maybe_hash, std::move(record)};
+		}
+
+		[[nodiscard]] auto index_header() const -> std::optional<IndexHeader> {
+			auto offset = size_t{};
+			auto maybe_header = read<IndexHeader>(maybe_index->bytes(), offset);
+			if (!maybe_header || maybe_header->magic != magic || maybe_header->version != version ||
+				maybe_index->bytes().size() != sizeof(IndexHeader) + maybe_header->number_of_slots * sizeof(Slot)) {
+				return std::nullopt;
+			}
+			return maybe_header;
+		}
+
+		[[nodiscard]] auto slot(size_t index) const -> Slot {
+			auto offset = sizeof(IndexHeader) + index * sizeof(Slot);
+			return *read<Slot>(maybe_index->bytes(), offset);
+		}
+
+		//Starts the record file over, and drops the index with it, unless it is of this version.
+		void check_records_version() {
+			auto header = RecordsHeader{};
+			{
+				auto is = std::ifstream{records_path, std::ios::binary};
+				if (is.read(reinterpret_cast<char *>(&header), sizeof(header)) && header.magic == records_magic && header.version == version) {
+					return;
+				}
+			}
+			stdc::fs::remove(index_path);
+			auto os = std::ofstream{records_path, std::ios::binary | std::ios::trunc};
+			header = RecordsHeader{records_magic, version, 0};
+			if (!os.write(reinterpret_cast<const char *>(&header), sizeof(header))) {
+				throw std::runtime_error{"Cannot write " + records_path.string() + "."};
+			}
+		}
+
+		//Maps both files and reads the records past the index, dropping a truncated one at the end.
+		void open() {
+			maybe_index.emplace(index_path);
+			maybe_records.emplace(records_path);
+			auto maybe_header = index_header();
+			auto offset = maybe_header ? maybe_header->records_size : sizeof(RecordsHeader);
+			if (offset > maybe_records->bytes().size()) {
+				maybe_index.reset();
+				maybe_index.emplace(stdc::fs::path{});
+				offset = sizeof(RecordsHeader);
+			}
+
+			unindexed.clear();
+			while (offset < maybe_records->bytes().size()) {
+				auto record_offset = offset;
+				auto maybe_record = read_record(maybe_records->bytes(), offset);
+				if (!maybe_record) {
+					maybe_records.reset();
+					stdc::fs::resize_file(records_path, record_offset);
+					maybe_records.emplace(records_path);
+					offset = record_offset;
+					break;
+				}
+				unindexed.emplace(maybe_record->first, std::pair{record_offset, std::move(maybe_record->second)});
+			}
+			records_size = offset;
+		}
+
+		[[nodiscard]] auto to_result(const CanonicalLevel &canonical, const Board &board, const Record &record) const -> std::optional<SolverResult> {
+			auto result = SolverResult{};
+			if (!record.is_solved) {
+				result.proven_unsolvable = true;
+				return result;
+			}
+			auto pushes = std::vector<Push>{};
+			for (auto push : record.pushes) {
+				auto maybe_push = canonical.to_board(push);
+				if (!maybe_push) {
+					return std::nullopt;
+				}
+				pushes.push_back(*maybe_push);
+			}
+			result.solution = pushes_to_lurd(board, pushes);
+			if (!result.solution) {
+				return std::nullopt;
+			}
+			return result;
+		}
+
+		//The current record of the level. Only ever the newest one is better than the others, see add.
+		[[nodiscard]] auto find_record(const CanonicalLevel &canonical) const -> std::optional<Record> {
+			auto hash = canonical.get_hash();
+
+			auto maybe_newest = std::optional<std::pair<std::uint64_t, const Record *>>{};
+			auto [first, last] = unindexed.equal_range(hash);
+			for (auto it = first; it != last; ++it) {
+				if (it->second.second.key == canonical.get_key() && (!maybe_newest || maybe_newest->first < it->second.first)) {
+					maybe_newest = std::pair{it->second.first, &it->second.second};
+				}
+			}
+			if (maybe_newest) {
+				return *maybe_newest->second;
+			}
+
+			//save() indexes only the newest record of each level.
+			if (auto maybe_header = index_header()) {
+				auto mask = maybe_header->number_of_slots - 1;
+				for (auto index = hash & mask; ; index = (index + 1) & mask) {
+					auto candidate = slot(index);
+					if (candidate.offset == empty) {
+						break;
+					}
+					if (candidate.hash != hash) {
+						continue;
+					}
+					auto offset = candidate.offset;
+					auto maybe_record = read_record(maybe_records->bytes(), offset);
+					if (maybe_record && maybe_record->second.key == canonical.get_key()) {
+						return std::move(maybe_record->second);
+					}
+				}
+			}
+			return std::nullopt;
+		}
+
+		//Whether a record the index does not cover yet is of the same level and newer than the one at `offset`.
+		[[nodiscard]] auto is_superseded(std::uint64_t hash, std::uint64_t offset, const std::vector<std::uint8_t> &key) const -> bool {
+			auto [first, last] = unindexed.equal_range(hash);
+			return std::any_of(first, last, [&](const auto &entry) { return entry.second.first > offset && entry.second.second.key == key; });
+		}
+
+		//The newest record of every level.
+		[[nodiscard]] auto current_slots() const -> std::vector<Slot> {
+			auto slots = std::vector<Slot>{};
+			if (auto maybe_header = index_header()) {
+				for (auto index = size_t{}; index < maybe_header->number_of_slots; ++index) {
+					auto old_slot = slot(index);
+					if (old_slot.offset == empty) {
+						continue;
+					}
+					if (unindexed.count(old_slot.hash)) {
+						auto offset = size_t{old_slot.offset};
+						auto maybe_record = read_record(maybe_records->bytes(), offset);
+						if (maybe_record && is_superseded(old_slot.hash, old_slot.offset, maybe_record->second.key)) {
+							continue;
+						}
+					}
+					slots.push_back(old_slot);
+				}
+			}
+			for (const auto &[hash, entry] : unindexed) {
+				if (!is_superseded(hash, entry.first, entry.second.key)) {
+					slots.push_back(Slot{hash, entry.first});
+				}
+			}
+			return slots;
+		}
+
+	public:
+		//Creates the directory if it is missing. A record file of another version is started over.
+		explicit ResultCache(const stdc::fs::path &directory) :
+			records_path{directory / "results"},
+			index_path{directory / "results.index"}
+		{
+			stdc::fs::create_directories(directory);
+			check_records_version();
+			open();
+		}
+
+		ResultCache(const This &) = delete;
+		auto operator=(const This &) & -> ResultCache & = delete;
+		ResultCache(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> ResultCache & = delete;
+		~ResultCache() = default;
+
+		//The cached result with zero statistics. With `requires_optimal`, a solution only counts if it is
+		//push-optimal. Throws std::invalid_argument if the level is malformed.
+		[[nodiscard]] auto find(Level level, bool requires_optimal) const -> std::optional<SolverResult> {
+			auto board = Board{level};
+			auto canonical = CanonicalLevel{board};
+			auto maybe_record = find_record(canonical);
+			if (!maybe_record || (requires_optimal && maybe_record->is_solved && !maybe_record->is_optimal)) {
+				return std::nullopt;
+			}
+			return to_result(canonical, board, *maybe_record);
+		}
+
+		//Appends the result if it is a solution or a proof and better than what the cache holds for the level.
+		//`is_optimal` tells whether the search that found a solution promised push-optimality, `is_complete` whether
+		//the search that found a proof saw every position, see SolverOptions::can_prove_unsolvable. Other proofs are
+		//not kept. Throws std::invalid_argument if the level is malformed.
+		void add(Level level, const SolverResult &result, bool is_optimal, bool is_complete) {
+			if (!result.solution && !(result.proven_unsolvable && is_complete)) {
+				return;
+			}
+			auto board = Board{level};
+			auto canonical = CanonicalLevel{board};
+
+			auto record = Record{canonical.get_key(), result.solution.has_value(), is_optimal && result.solution.has_value(), {}};
+			if (result.solution) {
+				auto maybe_pushes = lurd_to_pushes(board, *result.solution);
+				if (!maybe_pushes) {
+					throw std::invalid_argument{"The solution does not solve the level."};
+				}
+				for (auto push : *maybe_pushes) {
+					record.pushes.push_back(canonical.to_canonical(push));
+				}
+			}
+			if (auto maybe_old = find_record(canonical); maybe_old && !record.is_better_than(*maybe_old)) {
+				return;
+			}
+
+			auto os = std::ofstream{records_path, std::ios::binary | std::ios::app};
+			auto write = [&](const auto &value) { os.write(reinterpret_cast<const char *>(&value), sizeof(value)); };
+			write(canonical.get_hash());
+			write(static_cast<std::uint32_t>(record.key.size()));
+			os.write(reinterpret_cast<const char *>(record.key.data()), static_cast<std::streamsize>(record.key.size()));
+			write(std::uint8_t{record.is_solved});
+			write(std::uint8_t{record.is_optimal});
+			write(static_cast<std::uint32_t>(record.pushes.size()));
+			os.write(reinterpret_cast<const char *>(record.pushes.data()), static_cast<std::streamsize>(record.pushes.size() * sizeof(std::uint32_t)));
+			if (!os.flush()) {
+				throw std::runtime_error{"Cannot write " + records_path.string() + "."};
+			}
+
+			auto offset = records_size;
+			records_size += sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t) + record.key.size() + 2 + record.pushes.size() * sizeof(std::uint32_t);
+			unindexed.emplace(canonical.get_hash(), std::pair{offset, std::move(record)});
+		}
+
+		[[nodiscard]] auto number_of_results() const -> size_t {
+			return current_slots().size();
+		}
+
+		//Rewrites the index to cover the newest record of every level.
+		void save() {
+			if (unindexed.empty()) {
+				return;
+			}
+			auto slots = current_slots();
+
+			auto number_of_slots = std::uint64_t{64};
+			while (number_of_slots < 2 * slots.size()) {
+				number_of_slots *= 2;
+			}
+			auto table = std::vector<Slot>(number_of_slots, Slot{0, empty});
+			for (const auto &new_slot : slots) {
+				auto index = new_slot.hash & (number_of_slots - 1);
+				while (table[index].offset != empty) {
+					index = (index + 1) & (number_of_slots - 1);
+				}
+				table[index] = new_slot;
+			}
+
+			auto temporary_path = stdc::fs::path{index_path.string() + ".tmp"};
+			{
+				auto os = std::ofstream{temporary_path, std::ios::binary | std::ios::trunc};
+				auto header = IndexHeader{magic, version, 0, records_size, number_of_slots};
+				os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+				os.write(reinterpret_cast<const char *>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(Slot)));
+				if (!os.flush()) {
+					throw std::runtime_error{"Cannot write " + temporary_path.string() + "."};
+				}
+			}
+			//Windows cannot replace a mapped file.
+			maybe_index.reset();
+			maybe_records.reset();
+			stdc::fs::rename(temporary_path, index_path);
+			open();
+		}
+	};
+
+} //namespace sstm
@@ -0,0 +1,470 @@
+#pragma once
+
+#include "board.h"
+#include "reachability.h"
+#include "sokoban_parser.h"
+#include "solver.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//The floor of a level cut at the articulation points of its cell graph. Each of those cells is a doorway of
+	//its own and the floor left over falls apart into rooms, so a one-wide corridor is a string of doorways.
+	//Areas are the rooms followed by the doorways.
+	class RoomDecomposition {
+	public:
+		static constexpr auto no_area = std::numeric_limits<std::uint32_t>::max();
+
+	private:
+		std::vector<std::uint32_t> areas_of_cells;
+		std::vector<std::vector<Cell>> cells_of_areas;
+		std::vector<std::vector<std::uint32_t>> neighbors_of_areas;
+		size_t number_of_rooms = 0;
+
+		void add_area(const Board &board, Cell first) {
+			auto area = static_cast<std::uint32_t>(cells_of_areas.size());
+			areas_of_cells[first] = area;
+			auto &cells = cells_of_areas.emplace_back(std::vector{first});
+			for (auto i = size_t{}; i < cells.size(); ++i) {
+				for (auto direction : all_directions) {
+					auto neighbor = board.neighbor(cells[i], direction);
+					if (areas_of_cells[neighbor] == no_area && !board.is_wall(neighbor)) {
+						areas_of_cells[neighbor] = area;
+						cells.push_back(neighbor);
+					}
+				}
+			}
+		}
+
+	public:
+		explicit RoomDecomposition(const Board &board) {
+			auto n = board.number_of_cells();
+			auto is_doorway = find_articulation_points(board);
+
+			//Doorways get their areas first so that the rooms cannot spread through them.
+			areas_of_cells.assign(n, no_area);
+			for (auto cell = Cell{}; cell < n; ++cell) {
+				if (is_doorway[cell]) {
+					areas_of_cells[cell] = 0;
+				}
+			}
+			for (auto cell = Cell{}; cell < n; ++cell) {
+				if (areas_of_cells[cell] == no_area && !board.is_wall(cell)) {
+					add_area(board, cell);
+				}
+			}
+			number_of_rooms = cells_of_areas.size();
+			for (auto cell = Cell{}; cell < n; ++cell) {
+				if (is_doorway[cell]) {
+					areas_of_cells[cell] = static_cast<std::uint32_t>(cells_of_areas.size());
+					cells_of_areas.push_back({cell});
+				}
+			}
+
+			//Rooms only ever touch doorways, doorways touch rooms and each other.
+			neighbors_of_areas.resize(cells_of_areas.size());
+			for (auto area = number_of_rooms; area < cells_of_areas.size(); ++area) {
+				auto cell = cells_of_areas[area].front();
+				for (auto direction : all_directions) {
+					auto neighbor = board.neighbor(cell, direction);
+					if (board.is_wall(neighbor)) {
+						continue;
+					}
+					auto other = areas_of_cells[neighbor];
+					if (std::find(RANGE(neighbors_of_areas[area]), other) == neighbors_of_areas[area].end()) {
+						neighbors_of_areas[area].push_back(other);
+						if (other < number_of_rooms) {
+							neighbors_of_areas[other].push_back(static_cast<std::uint32_t>(area));
+						}
+					}
+				}
+			}
+		}
+
+		[[nodiscard]] auto area_of(Cell cell) const -> std::uint32_t { return areas_of_cells[cell]; }
+		[[nodiscard]] auto cells_of(std::uint32_t area) const -> const auto & { return cells_of_areas[area]; }
+		[[nodiscard]] auto neighbors_of(std::uint32_t area) const -> const auto & { return neighbors_of_areas[area]; }
+		[[nodiscard]] auto number_of_areas() const -> size_t { return cells_of_areas.size(); }
+		[[nodiscard]] auto get_number_of_rooms() const -> size_t { return number_of_rooms; }
+		[[nodiscard]] auto get_number_of_doorways() const -> size_t { return cells_of_areas.size() - number_of_rooms; }
+	};
+
+	//The decompositions of the levels of a run, each computed the first time it is asked for. A decomposition
+	//only depends on where the board has floor, so levels that differ in their boxes, goals or player share it.
+	//Floors are compared in full, the hash only picks the bucket.
+	class RoomDecompositionCache {
+	private:
+		//The board width, then one byte per cell that is 1 for floor.
+		using Floor = std::vector<std::uint8_t>;
+		using Entries = std::vector<std::pair<Floor, std::shared_ptr<const RoomDecomposition>>>;
+
+		std::mutex mutex;
+		std::unordered_map<std::uint64_t, Entries> entries_by_hash;
+
+		[[nodiscard]] static auto floor_of(const Board &board) -> Floor {
+			auto floor = Floor(sizeof(std::uint64_t) + board.number_of_cells());
+			auto width = std::uint64_t{board.get_width()};
+			std::memcpy(floor.data(), &width, sizeof(width));
+			for (auto cell = Cell{}; cell < board.number_of_cells(); ++cell) {
+				floor[sizeof(std::uint64_t) + cell] = !board.is_wall(cell);
+			}
+			return floor;
+		}
+
+		[[nodiscard]] static auto hash_floor(const Floor &floor) -> std::uint64_t {
+			//FNV-1a.
+			auto hash = std::uint64_t{14695981039346656037u};
+			for (auto byte : floor) {
+				hash = (hash ^ byte) * 1099511628211u;
+			}
+			return hash;
+		}
+
+		[[nodiscard]] static auto find(const Entries &entries, const Floor &floor) -> std::shared_ptr<const RoomDecomposition> {
+			for (const auto &[other_floor, decomposition] : entries) {
+				if (other_floor == floor) {
+					return decomposition;
+				}
+			}
+			return nullptr;
+		}
+
+	public:
+		[[nodiscard]] auto get(const Board &board) -> std::shared_ptr<const RoomDecomposition> {
+			auto floor = floor_of(board);
+			auto hash = hash_floor(floor);
+			{
+				auto lock = std::scoped_lock{mutex};
+				if (auto decomposition = find(entries_by_hash[hash], floor)) {
+					return decomposition;
+				}
+			}
+
+			//Large levels take a while, other levels need not wait for them.
+			auto decomposition = std::make_shared<const RoomDecomposition>(board);
+			auto lock = std::scoped_lock{mutex};
+			auto &entries = entries_by_hash[hash];
+			if (auto other = find(entries, floor)) {
+				return other;
+			}
+			entries.emplace_back(std::move(floor), decomposition);
+			return decomposition;
+		}
+	};
+
+	//Areas put together into groups, each solved on its own. Merged groups are left empty, so that group ids stay.
+	struct RoomGroups {
+		static constexpr auto no_group = RoomDecomposition::no_area;
+
+		std::vector<std::vector<std::uint32_t>> groups;
+		std::vector<std::uint32_t> groups_of_areas;
+
+		[[nodiscard]] auto group_of(const RoomDecomposition &rooms, Cell cell) const -> std::uint32_t {
+			auto area = rooms.area_of(cell);
+			return area == RoomDecomposition::no_area ? no_group : groups_of_areas[area];
+		}
+
+		[[nodiscard]] auto number_of_groups() const -> size_t {
+			return static_cast<size_t>(std::count_if(RANGE(groups), [](const auto &areas) { return !areas.empty(); }));
+		}
+
+		//Breadth-first from every area of the group at once to the nearest group that `is_wanted`. The group takes it
+		//in, with the areas between them. Returns the group taken in, if there was one.
+		auto merge_nearest(const RoomDecomposition &rooms, std::uint32_t group, auto is_wanted) -> std::optional<std::uint32_t> {
+			auto parents = std::vector<std::uint32_t>(rooms.number_of_areas(), no_group);
+			auto queue = groups[group];
+			for (auto area : queue) {
+				parents[area] = area;
+			}
+			for (auto i = size_t{}; i < queue.size(); ++i) {
+				for (auto neighbor : rooms.neighbors_of(queue[i])) {
+					if (parents[neighbor] != no_group) {
+						continue;
+					}
+					parents[neighbor] = queue[i];
+					auto other = groups_of_areas[neighbor];
+					if (other == no_group || !is_wanted(other)) {
+						queue.push_back(neighbor);
+						continue;
+					}
+
+					for (auto area : groups[other]) {
+						groups_of_areas[area] = group;
+					}
+					groups[group].insert(groups[group].end(), RANGE(groups[other]));
+					groups[other].clear();
+					for (auto area = parents[neighbor]; groups_of_areas[area] == no_group; area = parents[area]) {
+						groups_of_areas[area] = group;
+						groups[group].push_back(area);
+					}
+					return other;
+				}
+			}
+			return std::nullopt;
+		}
+	};
+
+	//Areas with boxes or goals, grouped so that every group has as many goals as boxes. A group that is off
+	//balance takes in the nearest group off the other way.
+	[[nodiscard]] inline auto group_areas(const Board &board, const RoomDecomposition &rooms) -> RoomGroups {
+		auto n = rooms.number_of_areas();
+		auto balances = std::vector<std::int64_t>(n);
+		for (auto box : board.get_initial_boxes()) {
+			++balances[rooms.area_of(box)];
+		}
+		auto has_goal = std::vector<std::uint8_t>(n);
+		for (auto goal : board.get_goals()) {
+			--balances[rooms.area_of(goal)];
+			has_goal[rooms.area_of(goal)] = 1;
+		}
+
+		auto groups = RoomGroups{{}, std::vector<std::uint32_t>(n, RoomGroups::no_group)};
+		for (auto area = std::uint32_t{}; area < n; ++area) {
+			if (balances[area] || has_goal[area]) {
+				groups.groups_of_areas[area] = static_cast<std::uint32_t>(groups.groups.size());
+				groups.groups.push_back({area});
+			}
+		}
+		auto group_balances = std::vector<std::int64_t>(groups.groups.size());
+		for (auto group = size_t{}; group < groups.groups.size(); ++group) {
+			group_balances[group] = balances[groups.groups[group].front()];
+		}
+
+		//Boxes and goals in doorways belong with the nearest room, they are in the way of nothing else.
+		auto has_room = [&](std::uint32_t group) {
+			return std::any_of(RANGE(groups.groups[group]), [&](std::uint32_t area) { return area < rooms.get_number_of_rooms(); });
+		};
+		for (auto group = std::uint32_t{}; group < groups.groups.size(); ++group) {
+			if (!groups.groups[group].empty() && !has_room(group)) {
+				if (auto maybe_other = groups.merge_nearest(rooms, group, has_room)) {
+					group_balances[group] += std::exchange(group_balances[*maybe_other], 0);
+				}
+			}
+		}
+
+		for (auto group = std::uint32_t{}; group < groups.groups.size(); ++group) {
+			while (group_balances[group]) {
+				auto is_opposite = [&](std::uint32_t other) { return group_balances[other] && (group_balances[other] > 0) != (group_balances[group] > 0); };
+				auto maybe_other = groups.merge_nearest(rooms, group, is_opposite);
+				//The balances of all groups add up to zero and the floor is connected.
+				assert(maybe_other);
+				group_balances[group] += std::exchange(group_balances[*maybe_other], 0);
+			}
+		}
+		return groups;
+	}
+
+	//Solves the groups of a room decomposition one at a time, every box outside the group standing still as a
+	//wall, and plays the solutions one after the other. The search space of each part is that of its own boxes
+	//only. When no group left can be solved, the smallest one takes in its nearest neighbor and the level is
+	//started over, down to a single group for the whole level if need be. The solution is not push-optimal, and
+	//the level is only proven unsolvable as a whole. The options, node and time limits included, apply to every part.
+	//The decomposition is looked up in `room_cache` if there is one, usually shared by all levels of a run.
+	[[nodiscard]] inline auto solve_by_rooms(Level level, SolverOptions options = {}, RoomDecompositionCache *room_cache = nullptr) -> SolverResult {
+		auto start = std::chrono::steady_clock::now();
+		auto board = Board{level};
+		//Boxes and goals the player can never get to belong to no area.
+		auto is_sealed = [&](Cell cell) { return board.is_wall(cell); };
+		if (std::any_of(RANGE(board.get_initial_boxes()), is_sealed) || std::any_of(RANGE(board.get_goals()), is_sealed)) {
+			return Solver{board, options}.run();
+		}
+		auto rooms = room_cache ? room_cache->get(board) : std::make_shared<const RoomDecomposition>(board);
+		auto groups = group_areas(board, *rooms);
+		if (groups.number_of_groups() <= 1) {
+			return Solver{board, options}.run();
+		}
+
+		auto result = SolverResult{};
+		auto add_statistics = [&](const SolverStatistics &statistics) {
+			result.statistics.expanded_nodes += statistics.expanded_nodes;
+			result.statistics.generated_nodes += statistics.generated_nodes;
+			stdc::maximize(result.statistics.stored_states, statistics.stored_states);
+			result.statistics.corral_prunings += statistics.corral_prunings;
+		};
+
+		auto n = board.number_of_cells();
+		auto has_box = std::vector<std::uint8_t>(n);
+		auto player = board.get_initial_player();
+		auto group_of = [&](Cell cell) { return groups.group_of(*rooms, cell); };
+		auto count_boxes = [&](std::uint32_t group) {
+			auto count = size_t{};
+			for (auto area : groups.groups[group]) {
+				count += static_cast<size_t>(std::count_if(RANGE(rooms->cells_of(area)), [&](Cell cell) { return has_box[cell]; }));
+			}
+			return count;
+		};
+
+		//The level as it stands, with the boxes of every group but `group` turned to walls and their goals to floor.
+		auto make_part = [&](std::uint32_t group) {
+			auto part = LevelStore{level};
+			for (auto r = size_t{}; r < level.get_height(); ++r) {
+				for (auto c = size_t{}; c < level.get_width(); ++c) {
+					auto piece = level.at(r, c);
+					if (piece == SokobanPiece::Wall || piece == SokobanPiece::Nothing) {
+						continue;
+					}
+					auto cell = board.cell_at(r, c);
+					auto is_own_goal = board.is_goal(cell) && group_of(cell) == group;
+					if (board.is_wall(cell) || (has_box[cell] && group_of(cell) != group)) {
+						piece = SokobanPiece::Wall;
+					} else if (has_box[cell]) {
+						piece = is_own_goal ? SokobanPiece::BoxAndGoal : SokobanPiece::Box;
+					} else if (cell == player) {
+						piece = is_own_goal ? SokobanPiece::PlayerAndGoal : SokobanPiece::Player;
+					} else {
+						piece = is_own_goal ? SokobanPiece::Goal : SokobanPiece::Floor;
+					}
+					part.set(0, r, c, piece);
+				}
+			}
+			return part;
+		};
+
+		auto unsolved = std::vector<std::uint32_t>{};
+		auto is_unsolved = std::vector<std::uint8_t>(groups.groups.size());
+		//Nothing changes for a group that failed until another one is solved or it takes in another.
+		auto has_failed = std::vector<std::uint8_t>(groups.groups.size());
+		auto restart = [&]() {
+			std::fill(RANGE(has_box), 0);
+			for (auto box : board.get_initial_boxes()) {
+				has_box[box] = 1;
+			}
+			player = board.get_initial_player();
+			result.solution.emplace();
+
+			//Groups with every box on a goal already are done.
+			unsolved.clear();
+			for (auto group = std::uint32_t{}; group < groups.groups.size(); ++group) {
+				auto is_done = std::all_of(RANGE(groups.groups[group]), [&](std::uint32_t area) {
+					return std::none_of(RANGE(rooms->cells_of(area)), [&](Cell cell) { return has_box[cell] && !board.is_goal(cell); });
+				});
+				is_unsolved[group] = !groups.groups[group].empty() && !is_done;
+				if (is_unsolved[group]) {
+					unsolved.push_back(group);
+				}
+			}
+			std::fill(RANGE(has_failed), 0);
+		};
+
+		//Whether the player gets to every box and goal of the group, walking through the group's own boxes like
+		//the sealing of its part does, and through those of the other unsolved groups if they may move first.
+		auto reached = std::vector<std::uint8_t>(n);
+		auto is_open = [&](std::uint32_t group, const std::vector<std::uint8_t> &boxes, Cell from, bool may_others_move) {
+			std::fill(RANGE(reached), 0);
+			auto stack = std::vector<Cell>{from};
+			reached[from] = 1;
+			while (!stack.empty()) {
+				auto cell = stack.back();
+				stack.pop_back();
+				for (auto direction : all_directions) {
+					auto next = board.neighbor(cell, direction);
+					auto owner = group_of(next);
+					auto is_passable = !boxes[next] || owner == group || (may_others_move && owner != RoomGroups::no_group && is_unsolved[owner]);
+					if (!reached[next] && !board.is_wall(next) && is_passable) {
+						reached[next] = 1;
+						stack.push_back(next);
+					}
+				}
+			}
+			for (auto area : groups.groups[group]) {
+				for (auto cell : rooms->cells_of(area)) {
+					if ((boxes[cell] || board.is_goal(cell)) && !reached[cell]) {
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+
+		auto try_part = [&](std::uint32_t group) -> bool {
+			if (has_failed[group]) {
+				return false;
+			}
+			has_failed[group] = 1;
+			if (!is_open(group, has_box, player, false)) {
+				return false;
+			}
+			//A player coming from elsewhere should be able to go back there, that is where the other groups are.
+			auto part_options = options;
+			if (group_of(player) != group && unsolved.size() > 1) {
+				part_options.maybe_player_goal = player;
+			}
+			auto part_result = solve(make_part(group)[0], part_options);
+			add_statistics(part_result.statistics);
+			result.proven_unsolvable = part_result.proven_unsolvable;
+			if (!part_result.solution) {
+				return false;
+			}
+
+			auto next_has_box = has_box;
+			auto next_player = player;
+			for (auto c : *part_result.solution) {
+				auto next = board.neighbor(next_player, *from_lurd(c));
+				if (next_has_box[next]) {
+					next_has_box[next] = 0;
+					next_has_box[board.neighbor(next, *from_lurd(c))] = 1;
+				}
+				next_player = next;
+			}
+			//The boxes of the part are there to stay. A part that shuts the player off from a group for good is
+			//left for later.
+			is_unsolved[group] = 0;
+			for (auto other : unsolved) {
+				if (other != group && !is_open(other, next_has_box, next_player, true)) {
+					is_unsolved[group] = 1;
+					return false;
+				}
+			}
+
+			has_box = std::move(next_has_box);
+			player = next_player;
+			*result.solution += *part_result.solution;
+			std::fill(RANGE(has_failed), 0);
+			return true;
+		};
+
+		restart();
+		while (!unsolved.empty()) {
+			auto solved = std::find_if(RANGE(unsolved), try_part);
+			if (solved != unsolved.end()) {
+				unsolved.erase(solved);
+				continue;
+			}
+			//The last part was the whole level, so its verdict is the level's.
+			if (groups.number_of_groups() == 1) {
+				result.solution.reset();
+				break;
+			}
+
+			//Every group left waits on another, or on one solved in a way that left it no way out. The smallest
+			//takes in its nearest neighbor, and everything starts over.
+			auto smallest = *std::min_element(RANGE(unsolved), [&](auto a, auto b) { return count_boxes(a) < count_boxes(b); });
+			auto maybe_other = groups.merge_nearest(*rooms, smallest, [&](std::uint32_t other) { return other != smallest; });
+			assert(maybe_other);
+			restart();
+		}
+		if (result.solution) {
+			result.proven_unsolvable = false;
+		}
+
+		result.statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return result;
+	}
+
+} //namespace sstm
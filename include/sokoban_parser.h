@@ -1,20 +1,186 @@
 #pragma once
 
+#include "mapped_file.h"
+
 #include <cool/filesystem.h>
 #include <cool/algorithm.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <optional>
+#include <random>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace sstm {
 
 	enum class SokobanPiece {Wall, Player, PlayerAndGoal, Box, BoxAndGoal, Goal, Floor, Nothing};
 
-	using Level = std::vector<std::vector<SokobanPiece>>;
+	//A view of a level in a LevelStore or a LevelPack, height rows of width pieces. Rows shorter than the longest
+	//are filled up with Nothing. Like an iterator, it is invalidated by adding levels to its store.
+	class Level {
+	public:
+		static constexpr auto bits_per_piece = size_t{3};
+		//Pieces do not straddle words, and each level starts a word of its own.
+		static constexpr auto pieces_per_word = size_t{64} / bits_per_piece;
+
+		[[nodiscard]] static constexpr auto number_of_words(size_t width, size_t height) { return (width * height + pieces_per_word - 1) / pieces_per_word; }
+
+	private:
+		const std::uint64_t *words = nullptr;
+		size_t width = 0;
+		size_t height = 0;
+
+	public:
+		Level() = default;
+
+		Level(const std::uint64_t *_words, size_t _width, size_t _height) :
+			words{_words},
+			width{_width},
+			height{_height}
+		{}
+
+		[[nodiscard]] auto get_width() const { return width; }
+		[[nodiscard]] auto get_height() const { return height; }
+		[[nodiscard]] auto empty() const { return width * height == 0; }
+
+		[[nodiscard]] auto at(size_t row, size_t column) const -> SokobanPiece {
+			auto index = row * width + column;
+			return static_cast<SokobanPiece>(words[index / pieces_per_word] >> index % pieces_per_word * bits_per_piece & 7u);
+		}
+
+		//The bits past the last piece are zero in every store.
+		friend auto operator==(const Level &lhs, const Level &rhs) -> bool {
+			return lhs.width == rhs.width && lhs.height == rhs.height && std::equal(lhs.words, lhs.words + number_of_words(lhs.width, lhs.height), rhs.words);
+		}
+	};
+
+	//From the Title: and Author: lines of a collection, empty where there are none.
+	struct LevelMetadata {
+		std::string title;
+		std::string author;
+	};
+
+	//Levels in one buffer of 3-bit pieces, instead of a vector per row and an int per piece. Titles and authors
+	//are kept in a side table of just the levels that have them. A store read from a LevelPack views the pieces
+	//right in the mapped file and keeps it open; such a store cannot be added to or set.
+	class LevelStore {
+	public:
+		struct Entry {
+			std::uint64_t first_word;
+			std::uint32_t width;
+			std::uint32_t height;
+		};
+
+		//By ascending level id.
+		using MetadataTable = std::vector<std::pair<size_t, LevelMetadata>>;
+
+	private:
+		std::vector<std::uint64_t> words;
+		std::vector<Entry> entries;
+		MetadataTable metadata;
+		//Set if the levels are in a mapped file rather than in words and entries.
+		std::shared_ptr<const MappedFile> maybe_mapped_file;
+		std::span<const std::uint64_t> mapped_words;
+		std::span<const Entry> mapped_entries;
+
+	public:
+		LevelStore() = default;
+
+		explicit LevelStore(Level level) {
+			push_back(level);
+		}
+
+		LevelStore(std::vector<std::uint64_t> _words, std::vector<Entry> _entries, MetadataTable _metadata = {}) :
+			words(std::move(_words)),
+			entries(std::move(_entries)),
+			metadata(std::move(_metadata))
+		{}
+
+		//The words and entries lie in `mapped_file`, which the store keeps open.
+		LevelStore(std::shared_ptr<const MappedFile> mapped_file, std::span<const std::uint64_t> _words, std::span<const Entry> _entries, MetadataTable _metadata) :
+			metadata(std::move(_metadata)),
+			maybe_mapped_file{std::move(mapped_file)},
+			mapped_words{_words},
+			mapped_entries{_entries}
+		{}
+
+		[[nodiscard]] auto get_words() const -> std::span<const std::uint64_t> { return maybe_mapped_file ? mapped_words : std::span{words}; }
+		[[nodiscard]] auto get_entries() const -> std::span<const Entry> { return maybe_mapped_file ? mapped_entries : std::span{entries}; }
+
+		[[nodiscard]] auto size() const { return get_entries().size(); }
+		[[nodiscard]] auto empty() const { return get_entries().empty(); }
 
-	inline auto maybe_sokoban_piece(auto c) -> std::optional<SokobanPiece> {
+		[[nodiscard]] auto operator[](size_t level_id) const -> Level {
+			const auto &entry = get_entries()[level_id];
+			return {get_words().data() + entry.first_word, entry.width, entry.height};
+		}
+
+		[[nodiscard]] auto get_metadata_table() const -> const auto & { return metadata; }
+
+		[[nodiscard]] auto get_metadata(size_t level_id) const -> LevelMetadata {
+			auto it = std::lower_bound(RANGE(metadata), level_id, [](const auto &entry, size_t id) { return entry.first < id; });
+			return it != metadata.end() && it->first == level_id ? it->second : LevelMetadata{};
+		}
+
+		void set_metadata(size_t level_id, LevelMetadata level_metadata) {
+			auto it = std::lower_bound(RANGE(metadata), level_id, [](const auto &entry, size_t id) { return entry.first < id; });
+			if (it != metadata.end() && it->first == level_id) {
+				it->second = std::move(level_metadata);
+			} else {
+				metadata.emplace(it, level_id, std::move(level_metadata));
+			}
+		}
+
+		//A level of Nothing, returns its id.
+		auto add(size_t width, size_t height) -> size_t {
+			assert(!maybe_mapped_file);
+			entries.push_back(Entry{words.size(), static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)});
+			auto number_of_pieces = width * height;
+			auto full_word = (std::uint64_t{1} << Level::pieces_per_word * Level::bits_per_piece) - 1;
+			words.resize(words.size() + number_of_pieces / Level::pieces_per_word, full_word);
+			if (auto rest = number_of_pieces % Level::pieces_per_word) {
+				words.push_back((std::uint64_t{1} << rest * Level::bits_per_piece) - 1);
+			}
+			return entries.size() - 1;
+		}
+
+		void push_back(Level level) {
+			auto level_id = add(level.get_width(), level.get_height());
+			for (auto row = size_t{}; row < level.get_height(); ++row) {
+				for (auto column = size_t{}; column < level.get_width(); ++column) {
+					set(level_id, row, column, level.at(row, column));
+				}
+			}
+		}
+
+		//Levels on separate threads may be set at the same time.
+		void set(size_t level_id, size_t row, size_t column, SokobanPiece piece) {
+			assert(!maybe_mapped_file);
+			const auto &entry = entries[level_id];
+			auto index = row * entry.width + column;
+			auto &word = words[entry.first_word + index / Level::pieces_per_word];
+			auto shift = index % Level::pieces_per_word * Level::bits_per_piece;
+			word = (word & ~(std::uint64_t{7} << shift)) | std::uint64_t{static_cast<std::uint8_t>(piece)} << shift;
+		}
+	};
+
+	inline constexpr auto maybe_sokoban_piece(auto c) -> std::optional<SokobanPiece> {
 		switch (c) {
 			case '#': return SokobanPiece::Wall;
 			case '@': return SokobanPiece::Player;
@@ -22,72 +188,578 @@ namespace sstm {
 			case '$': return SokobanPiece::Box;
 			case '*': return SokobanPiece::BoxAndGoal;
 			case '.': return SokobanPiece::Goal;
-			case ' ': return SokobanPiece::Floor;
+			case ' ':
+			case '-':
+			case '_': return SokobanPiece::Floor;
 			default: return std::nullopt;
 		}
 	}
 
-	inline auto maybe_to_level_row(std::string_view line) -> std::optional<std::vector<SokobanPiece>> {
-		auto row = std::vector<SokobanPiece>{};
-		row.reserve(line.size());
-		
-		auto nothing_so_far = true;
+	//maybe_sokoban_piece of every byte.
+	inline constexpr auto pieces_of_bytes = [] {
+		auto table = std::array<std::optional<SokobanPiece>, 256>{};
+		for (auto byte = size_t{}; byte < table.size(); ++byte) {
+			table[byte] = maybe_sokoban_piece(static_cast<char>(byte));
+		}
+		return table;
+	}();
+
+	//Longer counts of a run-length encoded row are taken for something else.
+	inline constexpr auto max_digits_of_runs = size_t{4};
 
+	inline constexpr auto is_digit(char c) { return '0' <= c && c <= '9'; }
+
+	//The bytes of rows as they have always been written.
+	inline constexpr auto plain_row_bytes = [] {
+		auto table = std::array<bool, 256>{};
+		for (auto c : std::string_view{"#@+$*. "}) {
+			table[static_cast<unsigned char>(c)] = true;
+		}
+		return table;
+	}();
+
+	enum class RowSyntax : std::uint8_t {
+		//Pieces only, a row as it has always been written.
+		Plain,
+		//Run-length encoded, a count before a piece or a | repeating it, several rows split by |, or - and _ for
+		//floor.
+		Extended,
+	};
+
+	//nullopt if the line is not a level row. Some collections draw lines of - or _ between levels, so an extended
+	//row needs a wall.
+	inline auto maybe_row_syntax(std::string_view line) -> std::optional<RowSyntax> {
+		if (line.empty()) {
+			return std::nullopt;
+		}
+		if (std::all_of(RANGE(line), [](char c) { return plain_row_bytes[static_cast<unsigned char>(c)]; })) {
+			return RowSyntax::Plain;
+		}
+		auto has_wall = false;
+		auto digits = size_t{};
 		for (auto c : line) {
-			if (auto maybe_piece = maybe_sokoban_piece(c)) {
-				if (nothing_so_far && *maybe_piece != SokobanPiece::Wall) {
-					row.push_back(SokobanPiece::Nothing);
-					continue;
+			if (is_digit(c)) {
+				if (++digits > max_digits_of_runs) {
+					return std::nullopt;
 				}
-				nothing_so_far = false;
-				row.push_back(*maybe_piece);
-			} else {
+				continue;
+			}
+			if (c != '|' && !pieces_of_bytes[static_cast<unsigned char>(c)]) {
 				return std::nullopt;
 			}
+			has_wall |= c == '#';
+			digits = 0;
+		}
+		if (!has_wall || digits) {
+			return std::nullopt;
+		}
+		return RowSyntax::Extended;
+	}
+
+	//Calls on_row with each row of an extended level line, with runs expanded into `buffer`. A count before | repeats
+	//the row, and a trailing | ends the last row.
+	constexpr void for_each_row(std::string_view line, std::string &buffer, auto &&on_row) {
+		buffer.clear();
+		auto maybe_count = std::optional<size_t>{};
+		for (auto c : line) {
+			if (is_digit(c)) {
+				maybe_count = maybe_count.value_or(0) * 10 + static_cast<size_t>(c - '0');
+				continue;
+			}
+			auto count = maybe_count.value_or(1);
+			maybe_count.reset();
+			if (c != '|') {
+				buffer.append(count, c);
+				continue;
+			}
+			for (auto i = size_t{}; i < count; ++i) {
+				on_row(std::string_view{buffer});
+			}
+			buffer.clear();
+		}
+		if (line.empty() || line.back() != '|') {
+			on_row(std::string_view{buffer});
 		}
+	}
+
+	static_assert([] {
+		auto rows = std::string{};
+		auto buffer = std::string{};
+		for (auto line : {std::string_view{"6#|#-@$.#|#4-#3|6#"}, std::string_view{"4#|#.$-@#|4#|"}}) {
+			for_each_row(line, buffer, [&](std::string_view row) { rows.append(row).push_back('/'); });
+		}
+		return rows == "######/#-@$.#/#----#/#----#/#----#/######/####/#.$-@#/####/";
+	}());
 
-		if (row.empty()) {
+	//The key and the value of a Title: or Author: line, whatever its case.
+	inline auto maybe_metadata(std::string_view line) -> std::optional<std::pair<std::string_view, std::string_view>> {
+		auto first = line.empty() ? 0 : std::tolower(static_cast<unsigned char>(line[0]));
+		if (first != 't' && first != 'a') {
 			return std::nullopt;
 		}
-		
+		for (auto key : {std::string_view{"title:"}, std::string_view{"author:"}}) {
+			if (line.size() >= key.size() && std::equal(RANGE(key), line.begin(), [](char lhs, char rhs) { return lhs == std::tolower(static_cast<unsigned char>(rhs)); })) {
+				auto value = line.substr(key.size());
+				auto value_begin = value.find_first_not_of(" \t");
+				return std::pair{key, value_begin == std::string_view::npos ? std::string_view{} : value.substr(value_begin, value.find_last_not_of(" \t") - value_begin + 1)};
+			}
+		}
+		return std::nullopt;
+	}
 
-		return row;
+	//Calls on_piece(column, piece) for each piece of a level row from its first wall on, the cells before it are
+	//outside the level.
+	inline void for_each_piece(std::string_view row, auto &&on_piece) {
+		for (auto column = std::min(row.find('#'), row.size()); column < row.size(); ++column) {
+			on_piece(column, *pieces_of_bytes[static_cast<unsigned char>(row[column])]);
+		}
+	}
+
+	//Calls on_line with each line of `text` and the offset of the next one. Line breaks are \n or \r\n, and the
+	//last line needs none.
+	inline void for_each_line(std::string_view text, size_t begin, size_t end, auto &&on_line) {
+		while (begin < end) {
+			auto line_end = text.find('\n', begin);
+			auto next = line_end == std::string_view::npos ? text.size() : line_end + 1;
+			auto line = text.substr(begin, std::min(line_end, text.size()) - begin);
+			if (!line.empty() && line.back() == '\r') {
+				line.remove_suffix(1);
+			}
+			on_line(line, next);
+			begin = next;
+		}
 	}
 
-	inline auto get_line_portable(auto &fs) -> std::string {
-		auto line = std::string{};
-		std::getline(fs, line);
-		if (!line.empty() && line.back() == '\r') {
-			line.pop_back();
+	//A run of consecutive row lines as the bytes [begin, end) of a collection, with its longest row and its
+	//number of rows.
+	struct LevelSpan {
+		size_t begin;
+		size_t end;
+		size_t width = 0;
+		size_t height = 0;
+		bool has_extended_rows = false;
+	};
+
+	//Calls task(i) for each i < count, on up to number_of_threads threads that take the next i in turn.
+	inline void parallel_for(size_t count, size_t number_of_threads, const auto &task) {
+		if (number_of_threads <= 1) {
+			for (auto i = size_t{}; i < count; ++i) {
+				task(i);
+			}
+			return;
+		}
+		auto next = std::atomic<size_t>{0};
+		auto threads = std::vector<std::jthread>{};
+		for (auto thread_id = size_t{}; thread_id < number_of_threads; ++thread_id) {
+			threads.emplace_back([&]() {
+				for (auto i = next++; i < count; i = next++) {
+					task(i);
+				}
+			});
 		}
-		return line;
-	} 
+	}
+
+	//One per MiB of text, up to one per hardware thread.
+	[[nodiscard]] inline auto number_of_parse_threads(std::string_view text) -> size_t {
+		constexpr auto min_chunk_size = size_t{1} << 20;
+		return std::clamp(text.size() / min_chunk_size, size_t{1}, size_t{std::max(std::thread::hardware_concurrency(), 1u)});
+	}
 
-	inline auto parse_collection(const stdc::fs::path &file) -> std::vector<Level>{
-		auto fs = std::fstream{file};
+	//Where the levels of a collection are, and what its Title: and Author: lines say about them.
+	struct CollectionScan {
+		std::vector<LevelSpan> spans;
+		LevelStore::MetadataTable metadata;
+	};
 
-		auto levels = std::vector<Level>{};
+	//Finds the runs of row lines in `text`, each a level. Threads scan chunks of whole lines, and runs meeting at
+	//a chunk boundary are joined.
+	inline auto scan_collection(std::string_view text) -> CollectionScan {
+		struct MetadataLine {
+			size_t offset;
+			std::string_view key;
+			std::string_view value;
+		};
 
+		auto number_of_chunks = number_of_parse_threads(text);
 
-		if (!fs.is_open()) {
-			assert(false); //TODO
+		auto chunk_begins = std::vector<size_t>{0};
+		for (auto chunk = size_t{1}; chunk < number_of_chunks; ++chunk) {
+			auto line_end = text.find('\n', std::max(chunk_begins.back(), text.size() / number_of_chunks * chunk));
+			chunk_begins.push_back(line_end == std::string_view::npos ? text.size() : line_end + 1);
 		}
+		chunk_begins.push_back(text.size());
+
+		auto chunk_spans = std::vector<std::vector<LevelSpan>>(number_of_chunks);
+		auto chunk_metadata_lines = std::vector<std::vector<MetadataLine>>(number_of_chunks);
+		parallel_for(number_of_chunks, number_of_chunks, [&](size_t chunk) {
+			auto &spans = chunk_spans[chunk];
+			auto buffer = std::string{};
+			auto currently_in_a_row_streak = false;
+			auto line_begin = chunk_begins[chunk];
+			for_each_line(text, chunk_begins[chunk], chunk_begins[chunk + 1], [&](std::string_view line, size_t next) {
+				if (auto maybe_syntax = maybe_row_syntax(line)) {
+					if (!currently_in_a_row_streak) {
+						currently_in_a_row_streak = true;
+						spans.push_back(LevelSpan{line_begin, next});
+					}
+					auto &span = spans.back();
+					span.end = next;
+					if (*maybe_syntax == RowSyntax::Plain) {
+						stdc::maximize(span.width, line.size());
+						++span.height;
+					} else {
+						span.has_extended_rows = true;
+						for_each_row(line, buffer, [&](std::string_view row) {
+							stdc::maximize(span.width, row.size());
+							++span.height;
+						});
+					}
+				} else {
+					currently_in_a_row_streak = false;
+					if (auto maybe_line = maybe_metadata(line)) {
+						chunk_metadata_lines[chunk].push_back(MetadataLine{line_begin, maybe_line->first, maybe_line->second});
+					}
+				}
+				line_begin = next;
+			});
+		});
 
-		auto currently_in_a_row_streak = false;
-		for (auto line = get_line_portable(fs); fs; line = get_line_portable(fs)) {
-			if (auto maybe_row = maybe_to_level_row(line)) {
-				if (!currently_in_a_row_streak) {
-					//Found a new level!
-					currently_in_a_row_streak = true;
-					levels.emplace_back();
+		auto scan = CollectionScan{};
+		auto &spans = scan.spans;
+		for (const auto &chunk : chunk_spans) {
+			for (auto span : chunk) {
+				if (!spans.empty() && spans.back().end == span.begin) {
+					auto &joined = spans.back();
+					joined.end = span.end;
+					stdc::maximize(joined.width, span.width);
+					joined.height += span.height;
+					joined.has_extended_rows |= span.has_extended_rows;
+				} else {
+					spans.push_back(span);
 				}
-				
-				levels.back().emplace_back(*maybe_row);
+			}
+		}
+
+		//Collections put the lines either above or below the board of their level. If the first one is above the
+		//first board, they are above throughout.
+		auto maybe_is_above = std::optional<bool>{};
+		for (const auto &chunk : chunk_metadata_lines) {
+			for (const auto &metadata_line : chunk) {
+				auto boards_before = static_cast<size_t>(std::partition_point(RANGE(spans), [&](LevelSpan span) { return span.begin < metadata_line.offset; }) - spans.begin());
+				if (!maybe_is_above) {
+					maybe_is_above = boards_before == 0;
+				}
+				if (*maybe_is_above ? boards_before == spans.size() : boards_before == 0) {
+					continue;
+				}
+				auto level_id = *maybe_is_above ? boards_before : boards_before - 1;
+				if (scan.metadata.empty() || scan.metadata.back().first != level_id) {
+					scan.metadata.emplace_back(level_id, LevelMetadata{});
+				}
+				auto &level_metadata = scan.metadata.back().second;
+				(metadata_line.key == "title:" ? level_metadata.title : level_metadata.author) = metadata_line.value;
+			}
+		}
+		return scan;
+	}
+
+	//Into `level_id` of `store`, which has the width and height of the span.
+	inline void decode_level(std::string_view text, LevelSpan span, LevelStore &store, size_t level_id) {
+		auto row = size_t{};
+		auto decode_row = [&](std::string_view pieces) {
+			for_each_piece(pieces, [&](size_t column, SokobanPiece piece) { store.set(level_id, row, column, piece); });
+			++row;
+		};
+		if (!span.has_extended_rows) {
+			for_each_line(text, span.begin, span.end, [&](std::string_view line, size_t) { decode_row(line); });
+			return;
+		}
+		auto buffer = std::string{};
+		for_each_line(text, span.begin, span.end, [&](std::string_view line, size_t) {
+			if (*maybe_row_syntax(line) == RowSyntax::Plain) {
+				decode_row(line);
 			} else {
-				currently_in_a_row_streak = false;
+				for_each_row(line, buffer, decode_row);
+			}
+		});
+	}
+
+	//Every level of the collection in `text`, decoded in parallel.
+	inline auto parse_collection_text(std::string_view text) -> LevelStore {
+		auto [spans, metadata] = scan_collection(text);
+		auto levels = LevelStore{{}, {}, std::move(metadata)};
+		for (auto span : spans) {
+			levels.add(span.width, span.height);
+		}
+		parallel_for(spans.size(), number_of_parse_threads(text), [&](size_t level_id) {
+			decode_level(text, spans[level_id], levels, level_id);
+		});
+		return levels;
+	}
+
+	[[nodiscard]] inline auto map_collection(const stdc::fs::path &file) -> std::unique_ptr<MappedFile> {
+		if (!stdc::fs::is_regular_file(file)) {
+			throw std::runtime_error{"Cannot read " + file.string() + "."};
+		}
+		return std::make_unique<MappedFile>(file);
+	}
+
+	[[nodiscard]] inline auto to_text(const MappedFile &mapped_file) -> std::string_view {
+		auto bytes = mapped_file.bytes();
+		return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+	}
+
+	//In nanoseconds of the file clock, 0 if the file has none.
+	[[nodiscard]] inline auto modification_time(const stdc::fs::path &file) -> std::int64_t {
+		auto error = std::error_code{};
+		auto time = stdc::fs::last_write_time(file, error);
+		return error ? 0 : std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+
+	//Of the whole text, eight bytes at a time, so checking a pack against its source costs little next to parsing it.
+	[[nodiscard]] inline auto checksum(std::string_view text) -> std::uint64_t {
+		auto mix = [](std::uint64_t hash, std::uint64_t word) {
+			hash = (hash ^ word) * 0x9e37'79b9'7f4a'7c15u;
+			return hash ^ hash >> 29;
+		};
+		auto hash = std::uint64_t{text.size()};
+		auto offset = size_t{};
+		for (; offset + sizeof(std::uint64_t) <= text.size(); offset += sizeof(std::uint64_t)) {
+			auto word = std::uint64_t{};
+			std::memcpy(&word, text.data() + offset, sizeof(word));
+			hash = mix(hash, word);
+		}
+		for (; offset < text.size(); ++offset) {
+			hash = mix(hash, static_cast<unsigned char>(text[offset]));
+		}
+		return hash;
+	}
+
+	//A collection compiled to the .sstmpack format: a header with the size, modification time and checksum of the
+	//text it was compiled from, followed by the entries and the words of its LevelStore, then its metadata table as
+	//level id, title size, author size, title and author. Raw fields in the byte order of the machine that wrote
+	//them, like the result cache. The levels are viewed right in the mapped file.
+	class LevelPack {
+	private:
+		using This = LevelPack;
+		using Entry = LevelStore::Entry;
+
+		static constexpr auto magic = std::uint64_t{0x314b'4341'5054'5353}; //"SSTPACK1"
+		static constexpr auto version = std::uint32_t{4};
+
+		struct Header {
+			std::uint64_t magic;
+			std::uint32_t version;
+			std::uint32_t unused;
+			std::uint64_t source_size;
+			//See modification_time.
+			std::int64_t source_time;
+			std::uint64_t source_checksum;
+			std::uint64_t number_of_levels;
+			std::uint64_t number_of_words;
+			std::uint64_t number_of_metadata;
+		};
+
+		struct MetadataHeader {
+			std::uint64_t level_id;
+			std::uint32_t title_size;
+			std::uint32_t author_size;
+		};
+
+		std::shared_ptr<const MappedFile> mapped_file;
+		Header header{};
+		LevelStore::MetadataTable metadata;
+
+		//The mapping starts at a page, and the header and entries keep the entries and the words aligned.
+		[[nodiscard]] auto entries() const -> std::span<const Entry> {
+			return {reinterpret_cast<const Entry *>(mapped_file->bytes().data() + sizeof(Header)), header.number_of_levels};
+		}
+
+		[[nodiscard]] auto words() const -> std::span<const std::uint64_t> {
+			return {reinterpret_cast<const std::uint64_t *>(mapped_file->bytes().data() + sizeof(Header) + header.number_of_levels * sizeof(Entry)), header.number_of_words};
+		}
+
+	public:
+		//A missing, truncated or foreign file opens as a pack of no source.
+		explicit LevelPack(const stdc::fs::path &path) :
+			mapped_file{std::make_shared<const MappedFile>(path)}
+		{
+			auto bytes = mapped_file->bytes();
+			if (bytes.size() < sizeof(Header)) {
+				return;
+			}
+			std::memcpy(&header, bytes.data(), sizeof(Header));
+			if (header.magic != magic || header.version != version || (bytes.size() - sizeof(Header)) / sizeof(Entry) < header.number_of_levels ||
+				(bytes.size() - sizeof(Header) - header.number_of_levels * sizeof(Entry)) / sizeof(std::uint64_t) < header.number_of_words) {
+				header = Header{};
+				return;
 			}
+			for (const auto &level_entry : entries()) {
+				if (level_entry.first_word > header.number_of_words || header.number_of_words - level_entry.first_word < Level::number_of_words(level_entry.width, level_entry.height)) {
+					header = Header{};
+					return;
+				}
+			}
+
+			auto offset = sizeof(Header) + header.number_of_levels * sizeof(Entry) + header.number_of_words * sizeof(std::uint64_t);
+			for (auto i = size_t{}; i < header.number_of_metadata; ++i) {
+				auto metadata_header = MetadataHeader{};
+				if (bytes.size() - offset < sizeof(MetadataHeader)) {
+					break;
+				}
+				std::memcpy(&metadata_header, bytes.data() + offset, sizeof(MetadataHeader));
+				offset += sizeof(MetadataHeader);
+				if (bytes.size() - offset < size_t{metadata_header.title_size} + metadata_header.author_size) {
+					break;
+				}
+				auto text = reinterpret_cast<const char *>(bytes.data() + offset);
+				metadata.emplace_back(metadata_header.level_id, LevelMetadata{{text, metadata_header.title_size}, {text + metadata_header.title_size, metadata_header.author_size}});
+				offset += size_t{metadata_header.title_size} + metadata_header.author_size;
+			}
+			if (metadata.size() != header.number_of_metadata || offset != bytes.size()) {
+				header = Header{};
+				metadata.clear();
+			}
+		}
+
+		LevelPack(const This &) = delete;
+		auto operator=(const This &) & -> LevelPack & = delete;
+		LevelPack(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> LevelPack & = delete;
+		~LevelPack() = default;
+
+		//Whether the pack was compiled from the collection as it is now. The collection is only read if it has the
+		//same size but another modification time, as after a copy or a checkout.
+		[[nodiscard]] auto is_compiled_from(const stdc::fs::path &source) const -> bool {
+			auto error = std::error_code{};
+			auto source_size = stdc::fs::file_size(source, error);
+			if (error || header.magic != magic || header.source_size != source_size) {
+				return false;
+			}
+			if (header.source_time == modification_time(source)) {
+				return true;
+			}
+			auto source_file = MappedFile{source};
+			return header.source_checksum == checksum(to_text(source_file));
+		}
+
+		[[nodiscard]] auto size() const -> size_t { return header.number_of_levels; }
+
+		[[nodiscard]] auto operator[](size_t level_id) const -> Level {
+			const auto &level_entry = entries()[level_id];
+			return {words().data() + level_entry.first_word, level_entry.width, level_entry.height};
+		}
+
+		[[nodiscard]] auto get_metadata_table() const -> const auto & { return metadata; }
+
+		//The levels viewed in the mapped file, which stays open as long as the store.
+		[[nodiscard]] auto to_store() const -> LevelStore {
+			return {mapped_file, words(), entries(), metadata};
+		}
+
+		//Replaces the file at `path` only once the pack is complete. `source_time` is the modification time of the
+		//collection from before `source` was read. Throws std::runtime_error if it cannot be written.
+		static void write(const stdc::fs::path &path, std::string_view source, std::int64_t source_time, const LevelStore &levels) {
+			const auto &entries = levels.get_entries();
+			const auto &words = levels.get_words();
+			//Unique, as several processes may compile the same collection at once. The last rename wins.
+			auto temporary_path = stdc::fs::path{path.string() + "." + std::to_string(std::random_device{}()) + ".tmp"};
+			auto error = std::error_code{};
+			{
+				auto os = std::ofstream{temporary_path, std::ios::binary | std::ios::trunc};
+				const auto &table = levels.get_metadata_table();
+				auto file_header = Header{magic, version, 0, source.size(), source_time, checksum(source), entries.size(), words.size(), table.size()};
+				os.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+				os.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+				os.write(reinterpret_cast<const char *>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(std::uint64_t)));
+				for (const auto &[level_id, level_metadata] : table) {
+					auto metadata_header = MetadataHeader{level_id, static_cast<std::uint32_t>(level_metadata.title.size()), static_cast<std::uint32_t>(level_metadata.author.size())};
+					os.write(reinterpret_cast<const char *>(&metadata_header), sizeof(metadata_header));
+					os << level_metadata.title << level_metadata.author;
+				}
+				if (!os.flush()) {
+					os.close();
+					stdc::fs::remove(temporary_path, error);
+					throw std::runtime_error{"Cannot write " + temporary_path.string() + "."};
+				}
+			}
+			stdc::fs::rename(temporary_path, path, error);
+			if (error) {
+				stdc::fs::remove(temporary_path, error);
+				throw std::runtime_error{"Cannot write " + path.string() + "."};
+			}
+		}
+	};
+
+	//Next to the collection, with .sstmpack appended to its name.
+	[[nodiscard]] inline auto level_pack_path(const stdc::fs::path &file) -> stdc::fs::path {
+		return file.string() + ".sstmpack";
+	}
+
+	//Maps the file into memory rather than reading it line by line, so even collections of hundreds of megabytes
+	//load in a fraction of a second. Views the levels in the collection's pack if it was compiled from the same
+	//text, without reading the text, otherwise parses the text and compiles the pack for the next time.
+	inline auto parse_collection(const stdc::fs::path &file) -> LevelStore {
+		auto pack_path = level_pack_path(file);
+		if (auto pack = LevelPack{pack_path}; pack.is_compiled_from(file)) {
+			return pack.to_store();
 		}
 
+		auto source_time = modification_time(file);
+		auto mapped_file = map_collection(file);
+		auto text = to_text(*mapped_file);
+		auto levels = parse_collection_text(text);
+		try {
+			LevelPack::write(pack_path, text, source_time, levels);
+		} catch (std::runtime_error &e) {
+			//A read-only directory only means parsing again next time.
+			std::cerr << e.what() << '\n';
+		}
 		return levels;
 	}
+
+	//Where the levels of a collection are and how large they are, found by one scan of the mapped file. A level is
+	//only decoded when it is asked for, so a collection of any size costs a few words per level. If the collection
+	//has an up-to-date pack, the levels are viewed in that instead and nothing is scanned.
+	class LevelIndex {
+	private:
+		std::unique_ptr<MappedFile> mapped_file;
+		CollectionScan scan;
+		std::optional<LevelStore> maybe_packed_levels;
+
+	public:
+		LevelIndex() = default;
+
+		explicit LevelIndex(const stdc::fs::path &file) {
+			if (auto pack = LevelPack{level_pack_path(file)}; pack.is_compiled_from(file)) {
+				maybe_packed_levels = pack.to_store();
+				return;
+			}
+			mapped_file = map_collection(file);
+			scan = scan_collection(to_text(*mapped_file));
+		}
+
+		[[nodiscard]] auto size() const { return maybe_packed_levels ? maybe_packed_levels->size() : scan.spans.size(); }
+		[[nodiscard]] auto empty() const { return size() == 0; }
+		[[nodiscard]] auto width(size_t level_id) const { return maybe_packed_levels ? (*maybe_packed_levels)[level_id].get_width() : scan.spans[level_id].width; }
+		[[nodiscard]] auto height(size_t level_id) const { return maybe_packed_levels ? (*maybe_packed_levels)[level_id].get_height() : scan.spans[level_id].height; }
+
+		//A store of just this level, as level 0.
+		[[nodiscard]] auto get(size_t level_id) const -> LevelStore {
+			if (maybe_packed_levels) {
+				auto level = LevelStore{(*maybe_packed_levels)[level_id]};
+				if (auto level_metadata = maybe_packed_levels->get_metadata(level_id); !level_metadata.title.empty() || !level_metadata.author.empty()) {
+					level.set_metadata(0, std::move(level_metadata));
+				}
+				return level;
+			}
+			auto level = LevelStore{};
+			decode_level(to_text(*mapped_file), scan.spans[level_id], level, level.add(width(level_id), height(level_id)));
+			auto it = std::lower_bound(RANGE(scan.metadata), level_id, [](const auto &entry, size_t id) { return entry.first < id; });
+			if (it != scan.metadata.end() && it->first == level_id) {
+				level.set_metadata(0, it->second);
+			}
+			return level;
+		}
+	};
 } //namespace sstm
\ No newline at end of file
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+#include "reachability.h"
+#include "sokoban_parser.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	struct OptimizerOptions {
+		//Longest run of pushes that is searched for a cheaper replacement.
+		size_t max_window = 6;
+		size_t max_window_nodes = 2'000;
+	};
+
+	//Shortens a solution in moves, then pushes. Loops in the push sequence are cut, walks between pushes are
+	//replaced by shortest ones, and windows of consecutive pushes are replaced by the cheapest sequence that
+	//gets the boxes they move to the same cells. The result is never worse than the input.
+	class SolutionOptimizer {
+	private:
+		static constexpr auto unreachable = std::numeric_limits<std::uint32_t>::max();
+
+		struct WindowNode {
+			std::vector<Cell> boxes;
+			Cell player;
+			std::uint32_t parent;
+			Push push;
+		};
+
+		const Board &board;
+		OptimizerOptions options;
+		std::vector<Push> pushes;
+
+		//Before each push and once more at the end: the boxes in index order and where the player stands.
+		std::vector<std::vector<Cell>> boxes_before;
+		std::vector<Cell> players_before;
+		//The walk to each push.
+		std::vector<std::uint32_t> walks;
+
+		std::vector<std::uint32_t> distances;
+		std::vector<Cell> queue;
+
+		void compute_distances(const std::vector<std::uint8_t> &occupied, Cell from) {
+			distances.assign(board.number_of_cells(), unreachable);
+			distances[from] = 0;
+			queue.assign(1, from);
+			for (auto i = size_t{}; i < queue.size(); ++i) {
+				auto cell = queue[i];
+				for (auto direction : all_directions) {
+					auto next = board.neighbor(cell, direction);
+					if (distances[next] == unreachable && !board.is_wall(next) && !occupied[next]) {
+						distances[next] = distances[cell] + 1;
+						queue.push_back(next);
+					}
+				}
+			}
+		}
+
+		[[nodiscard]] auto stand_of(const Push &push) const -> Cell {
+			return board.neighbor(push.box, opposite(push.direction));
+		}
+
+		void trace() {
+			auto position = Position{board};
+			boxes_before.clear();
+			players_before.clear();
+			walks.clear();
+
+			for (const auto &push : pushes) {
+				boxes_before.push_back(position.get_boxes());
+				players_before.push_back(position.player);
+				compute_distances(position.get_occupied(), position.player);
+				walks.push_back(distances[stand_of(push)]);
+				assert(walks.back() != unreachable);
+
+				position.move_box(position.index_of(push.box), board.neighbor(push.box, push.direction));
+				position.player = push.box;
+			}
+			boxes_before.push_back(position.get_boxes());
+			players_before.push_back(position.player);
+		}
+
+		[[nodiscard]] auto number_of_moves() const -> size_t {
+			return std::accumulate(RANGE(walks), pushes.size());
+		}
+
+		//Drops every push sequence that leads back to a state already passed, the player being anywhere in the same region.
+		[[nodiscard]] auto cut_loops() const -> std::vector<Push> {
+			auto position = Position{board};
+			auto reachability = Reachability{};
+			auto kept = std::vector<Push>{};
+			auto seen = std::map<std::vector<Cell>, size_t>{};
+
+			auto state_of = [&]() {
+				auto state = std::vector<Cell>(position.get_boxes().size() + 1);
+				position.store_sorted(state.data());
+				reachability.compute(position, position.player);
+				state.back() = reachability.normalized();
+				return state;
+			};
+
+			seen.emplace(state_of(), 0);
+			for (const auto &push : pushes) {
+				position.move_box(position.index_of(push.box), board.neighbor(push.box, push.direction));
+				position.player = push.box;
+				kept.push_back(push);
+
+				auto [it, is_new] = seen.try_emplace(state_of(), kept.size());
+				if (!is_new) {
+					auto loop_start = it->second;
+					kept.resize(loop_start);
+					std::erase_if(seen, [&](const auto &entry) { return entry.second > loop_start; });
+				}
+			}
+			return kept;
+		}
+
+		//Dijkstra over the boxes moved in pushes [first, first + length) and the exact player cell, weighted by
+		//moves. The window ends once those boxes stand where they did after it and the player can still walk
+		//to the next push; that walk counts too. Returns the cheaper pushes, if there are any.
+		[[nodiscard]] auto improve_window(size_t first, size_t length) -> std::optional<std::vector<Push>> {
+			auto last = first + length;
+			auto next_stand = last < pushes.size() ? stand_of(pushes[last]) : no_cell;
+			auto window_moves = std::accumulate(walks.begin() + static_cast<ptrdiff_t>(first), walks.begin() + static_cast<ptrdiff_t>(last), length);
+			if (next_stand != no_cell) {
+				window_moves += walks[last];
+			}
+
+			auto is_moved = std::vector<std::uint8_t>(boxes_before[first].size());
+			for (auto j = first; j < last; ++j) {
+				const auto &boxes = boxes_before[j];
+				is_moved[static_cast<size_t>(std::find(RANGE(boxes), pushes[j].box) - boxes.begin())] = 1;
+			}
+
+			auto occupied = std::vector<std::uint8_t>(board.number_of_cells());
+			auto start = WindowNode{{}, players_before[first], std::numeric_limits<std::uint32_t>::max(), Push{no_cell, Direction::Up}};
+			auto goal = std::vector<Cell>{};
+			for (auto i = size_t{}; i < is_moved.size(); ++i) {
+				if (is_moved[i]) {
+					start.boxes.push_back(boxes_before[first][i]);
+					goal.push_back(boxes_before[last][i]);
+				} else {
+					occupied[boxes_before[first][i]] = 1;
+				}
+			}
+			std::sort(RANGE(start.boxes));
+			std::sort(RANGE(goal));
+
+			auto nodes = std::vector<WindowNode>{std::move(start)};
+			auto best_costs = std::map<std::pair<std::vector<Cell>, Cell>, size_t>{{{nodes[0].boxes, nodes[0].player}, 0}};
+			auto open = std::priority_queue<std::pair<size_t, std::uint32_t>, std::vector<std::pair<size_t, std::uint32_t>>, std::greater<>>{};
+			open.emplace(0, 0);
+
+			auto best_moves = window_moves;
+			auto best_node = std::optional<std::uint32_t>{};
+			for (auto expanded = size_t{}; !open.empty() && expanded < options.max_window_nodes; ++expanded) {
+				auto [cost, id] = open.top();
+				open.pop();
+				if (cost >= best_moves) {
+					break;
+				}
+				if (best_costs[{nodes[id].boxes, nodes[id].player}] < cost) {
+					continue;
+				}
+
+				auto boxes = nodes[id].boxes;
+				for (auto box : boxes) {
+					occupied[box] = 1;
+				}
+				compute_distances(occupied, nodes[id].player);
+
+				if (boxes == goal) {
+					auto final_walk = next_stand == no_cell ? 0 : distances[next_stand];
+					if (final_walk != unreachable && cost + final_walk < best_moves) {
+						best_moves = cost + final_walk;
+						best_node = id;
+					}
+				}
+
+				for (auto i = size_t{}; i < boxes.size(); ++i) {
+					for (auto direction : all_directions) {
+						auto box = boxes[i];
+						auto stand = board.neighbor(box, opposite(direction));
+						auto target = board.neighbor(box, direction);
+						if (distances[stand] == unreachable || board.is_wall(target) || occupied[target] || board.is_dead_square(target)) {
+							continue;
+						}
+
+						auto child = WindowNode{boxes, box, id, Push{box, direction}};
+						child.boxes[i] = target;
+						std::sort(RANGE(child.boxes));
+						auto child_cost = cost + distances[stand] + 1;
+						auto [it, is_new] = best_costs.try_emplace({child.boxes, child.player}, child_cost);
+						if (!is_new && it->second <= child_cost) {
+							continue;
+						}
+						it->second = child_cost;
+						open.emplace(child_cost, static_cast<std::uint32_t>(nodes.size()));
+						nodes.push_back(std::move(child));
+					}
+				}
+
+				for (auto box : boxes) {
+					occupied[box] = 0;
+				}
+			}
+
+			if (!best_node) {
+				return std::nullopt;
+			}
+			auto replacement = std::vector<Push>{};
+			for (auto id = *best_node; id; id = nodes[id].parent) {
+				replacement.push_back(nodes[id].push);
+			}
+			std::reverse(RANGE(replacement));
+			return replacement;
+		}
+
+	public:
+		SolutionOptimizer(const Board &_board, std::vector<Push> _pushes, OptimizerOptions _options = {}) :
+			board{_board},
+			options{_options},
+			pushes{std::move(_pushes)}
+		{}
+
+		[[nodiscard]] auto run(std::stop_token stop_token = {}) -> std::string {
+			trace();
+			auto moves = number_of_moves();
+
+			auto previous = std::exchange(pushes, cut_loops());
+			trace();
+			if (number_of_moves() > moves) {
+				pushes = std::move(previous);
+				trace();
+			}
+
+			for (auto has_improved = true; has_improved && !stop_token.stop_requested();) {
+				has_improved = false;
+				for (auto length = size_t{1}; length <= options.max_window; ++length) {
+					for (auto first = size_t{}; first + length <= pushes.size() && !stop_token.stop_requested(); ++first) {
+						if (auto maybe_replacement = improve_window(first, length)) {
+							auto window = pushes.begin() + static_cast<ptrdiff_t>(first);
+							pushes.erase(window, window + static_cast<ptrdiff_t>(length));
+							pushes.insert(pushes.begin() + static_cast<ptrdiff_t>(first), RANGE(*maybe_replacement));
+							trace();
+							has_improved = true;
+						}
+					}
+				}
+			}
+
+			auto maybe_lurd = pushes_to_lurd(board, pushes);
+			assert(maybe_lurd);
+			return *maybe_lurd;
+		}
+	};
+
+	//Returns the optimized solution, or nullopt if the input does not solve the level.
+	[[nodiscard]] inline auto optimize_solution(const Board &board, std::string_view lurd, std::stop_token stop_token = {}, OptimizerOptions options = {}) -> std::optional<std::string> {
+		auto maybe_pushes = lurd_to_pushes(board, lurd);
+		if (!maybe_pushes) {
+			return std::nullopt;
+		}
+		auto optimized = SolutionOptimizer{board, std::move(*maybe_pushes), options}.run(stop_token);
+		if (optimized.size() >= lurd.size()) {
+			return std::string{lurd};
+		}
+		return optimized;
+	}
+
+	struct OptimizedSolution {
+		size_t level_id;
+		std::string solution;
+	};
+
+	//Optimizes solutions on worker threads. The game submits every solved level and collects the results
+	//once per frame, so it never waits for an optimization and only its own thread touches the high scores.
+	class BackgroundOptimizer {
+	private:
+		using This = BackgroundOptimizer;
+
+		struct Job {
+			size_t level_id;
+			//Of just the level, the game's may not live as long as the job.
+			LevelStore level;
+			std::string solution;
+		};
+
+		std::mutex mutex;
+		std::condition_variable_any has_jobs;
+		std::deque<Job> jobs;
+		std::vector<OptimizedSolution> finished;
+		//Last, so the threads are stopped and joined before anything they use goes away.
+		std::vector<std::jthread> threads;
+
+		void work(std::stop_token stop_token) {
+			while (true) {
+				auto lock = std::unique_lock{mutex};
+				if (!has_jobs.wait(lock, stop_token, [&]() { return !jobs.empty(); })) {
+					return;
+				}
+				auto job = std::move(jobs.front());
+				jobs.pop_front();
+				lock.unlock();
+
+				try {
+					auto board = Board{job.level[0]};
+					auto maybe_optimized = optimize_solution(board, job.solution, stop_token);
+					if (maybe_optimized && maybe_optimized->size() < job.solution.size()) {
+						lock.lock();
+						finished.push_back(OptimizedSolution{job.level_id, std::move(*maybe_optimized)});
+					}
+				} catch (std::invalid_argument &) {
+					//Levels the solver cannot analyse are not optimized either.
+				}
+			}
+		}
+
+	public:
+		explicit BackgroundOptimizer(size_t number_of_threads) {
+			for (auto i = size_t{}; i < std::max(number_of_threads, size_t{1}); ++i) {
+				threads.emplace_back([this](std::stop_token stop_token) { work(stop_token); });
+			}
+		}
+
+		BackgroundOptimizer(const This &) = delete;
+		auto operator=(const This &) & -> BackgroundOptimizer & = delete;
+		BackgroundOptimizer(This &&) noexcept = delete;
+		auto operator=(This &&) & noexcept -> BackgroundOptimizer & = delete;
+		~BackgroundOptimizer() = default;
+
+		void submit(size_t level_id, Level level, std::string solution) {
+			{
+				auto lock = std::lock_guard{mutex};
+				jobs.push_back(Job{level_id, LevelStore{level}, std::move(solution)});
+			}
+			has_jobs.notify_one();
+		}
+
+		[[nodiscard]] auto collect() -> std::vector<OptimizedSolution> {
+			auto lock = std::lock_guard{mutex};
+			return std::exchange(finished, {});
+		}
+	};
+
+} //namespace sstm
@@ -0,0 +1,696 @@
+#pragma once
+
+#include "board.h"
+#include "checkpoint.h"
+#include "corral.h"
+#include "deadlock.h"
+#include "deadlock_patterns.h"
+#include "macros.h"
+#include "matching.h"
+#include "position.h"
+#include "reachability.h"
+#include "transposition_table.h"
+
+#include <cool/algorithm.h>
+#include <cool/filesystem.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	struct SolverOptions {
+		size_t max_expanded_nodes = 20'000'000;
+		bool use_pi_corrals = true;
+		//Tunnel and goal-room macros, see MacroAnalysis. Off by default, as solutions found with them may not be
+		//push-optimal.
+		bool use_macros = false;
+		//Solver::run gives up after this long, as it does after max_expanded_nodes.
+		std::optional<std::chrono::milliseconds> maybe_time_limit;
+		//Solver::run and BidirectionalSolver::run give up once a stop is requested.
+		std::stop_token stop_token;
+		//Solver::run orders open states by cost + weight * lower bound. Above 1, solutions come sooner but are
+		//no longer push-optimal.
+		std::uint32_t weight = 1;
+		//Consulted for every push and grown by it, if set. Usually shared by all searches of a run.
+		const PatternDatabase *pattern_database = nullptr;
+		//Solver::run only accepts a solution that leaves the player able to walk to this cell. For parts of a level
+		//solved one by one, see solve_by_rooms.
+		std::optional<Cell> maybe_player_goal;
+		//Solver::run resumes the search saved in this file, if there is one, and saves it there every
+		//checkpoint_interval and when it gives up. The file is removed once the level is solved or proven unsolvable.
+		std::optional<stdc::fs::path> maybe_checkpoint_path;
+		std::chrono::seconds checkpoint_interval{300};
+		//Caps what Solver::run keeps of its search, in bytes. The node table stops growing at a quarter of it and
+		//evicts entries by `replacement` from then on. Once the nodes fill the rest, the open states that look worst
+		//are forgotten, to be found again from their parents when the search gets that far.
+		std::optional<size_t> maybe_memory_limit;
+		Replacement replacement = Replacement::Furthest;
+
+		//Whether Solver::run, solve_in_parallel and solve_bidirectional promise the fewest pushes with these options.
+		[[nodiscard]] auto is_push_optimal() const -> bool {
+			return !use_macros && weight == 1;
+		}
+
+		//Whether a search with these options that runs out of positions proves the level unsolvable. Macros skip some.
+		[[nodiscard]] auto can_prove_unsolvable() const -> bool {
+			return !use_macros;
+		}
+	};
+
+	struct SolverStatistics {
+		size_t expanded_nodes = 0;
+		size_t generated_nodes = 0;
+		size_t stored_states = 0;
+		size_t corral_prunings = 0;
+		//Dropped to stay within SolverOptions::maybe_memory_limit.
+		size_t forgotten_states = 0;
+		double seconds = 0.;
+
+		[[nodiscard]] auto nodes_per_second() const -> double {
+			return seconds > 0. ? static_cast<double>(expanded_nodes) / seconds : 0.;
+		}
+	};
+
+	struct SolverResult {
+		//A LURD move string, playable key by key through World::move.
+		std::optional<std::string> solution;
+		//The whole reachable state space was searched, so there is no solution.
+		bool proven_unsolvable = false;
+		SolverStatistics statistics;
+	};
+
+	//Open addressing set of node indices. Hashing and equality are left to the caller, which owns the states.
+	class NodeTable {
+	private:
+		static constexpr auto empty = std::numeric_limits<std::uint32_t>::max();
+
+		std::vector<std::uint32_t> slots = std::vector<std::uint32_t>(1 << 16, empty);
+		size_t size = 0;
+
+		template<typename HashOf>
+		void grow(const HashOf &hash_of) {
+			auto old_slots = std::exchange(slots, std::vector<std::uint32_t>(slots.size() * 2, empty));
+			auto mask = slots.size() - 1;
+			for (auto index : old_slots) {
+				if (index == empty) {
+					continue;
+				}
+				auto slot = hash_of(index) & mask;
+				while (slots[slot] != empty) {
+					slot = (slot + 1) & mask;
+				}
+				slots[slot] = index;
+			}
+		}
+
+	public:
+		//Returns the stored index equal to `candidate`, or inserts `candidate` and returns nullopt.
+		template<typename HashOf, typename Equal>
+		[[nodiscard]] auto find_or_insert(std::uint64_t hash, std::uint32_t candidate, const HashOf &hash_of, const Equal &equal) -> std::optional<std::uint32_t> {
+			if (2 * (size + 1) > slots.size()) {
+				grow(hash_of);
+			}
+
+			auto mask = slots.size() - 1;
+			for (auto slot = hash & mask; ; slot = (slot + 1) & mask) {
+				auto index = slots[slot];
+				if (index == empty) {
+					slots[slot] = candidate;
+					++size;
+					return std::nullopt;
+				}
+				if (hash_of(index) == hash && equal(index)) {
+					return index;
+				}
+			}
+		}
+
+		template<typename HashOf, typename Equal>
+		[[nodiscard]] auto find(std::uint64_t hash, const HashOf &hash_of, const Equal &equal) const -> std::optional<std::uint32_t> {
+			auto mask = slots.size() - 1;
+			for (auto slot = hash & mask; slots[slot] != empty; slot = (slot + 1) & mask) {
+				if (hash_of(slots[slot]) == hash && equal(slots[slot])) {
+					return slots[slot];
+				}
+			}
+			return std::nullopt;
+		}
+
+		[[nodiscard]] auto get_size() const { return size; }
+	};
+
+	//Entry of a best-first open list. std::priority_queue is a max heap, so this orders by smallest
+	//estimate first and, among equal estimates, by smallest lower bound, i.e. deepest first.
+	struct OpenEntry {
+		std::uint32_t estimate;
+		std::uint32_t lower_bound;
+		std::uint32_t cost;
+		std::uint32_t node;
+
+		[[nodiscard]] friend auto operator<(const OpenEntry &lhs, const OpenEntry &rhs) -> bool {
+			if (lhs.estimate != rhs.estimate) {
+				return lhs.estimate > rhs.estimate;
+			}
+			return lhs.lower_bound > rhs.lower_bound;
+		}
+	};
+
+	//An open list whose entries can also be thinned out, see Solver::forget.
+	class OpenList : public std::priority_queue<OpenEntry> {
+	public:
+		[[nodiscard]] auto entries() -> std::vector<OpenEntry> & { return c; }
+		void restore_heap() { std::make_heap(RANGE(c), comp); }
+		void reserve(size_t capacity) { c.reserve(capacity); }
+	};
+
+	//Produces the children of a position: legal pushes minus dead squares, freeze deadlocks, dead patterns and,
+	//if an unfinished PI-corral exists, every push outside of it. Pushes that start a macro are
+	//followed through to its end. Shared by all search strategies.
+	class SuccessorGenerator {
+	private:
+		const Board &board;
+		SolverOptions options;
+
+		Reachability reachability;
+		Reachability child_reachability;
+		CorralAnalysis corral_analysis;
+		MacroAnalysis macros;
+		std::vector<Push> macro_pushes;
+
+		//The matching of the expanded position, only computed once a child asks for its lower bound.
+		MatchingLowerBound matching;
+		bool is_matching_current = false;
+		MatchingLowerBound child_matching;
+		std::vector<Cell> parent_boxes;
+
+		template<typename Visit>
+		void try_push(Position &position, size_t index, Direction direction, const Visit &visit) {
+			auto box = position.get_boxes()[index];
+			auto target = board.neighbor(box, direction);
+			if (!position.is_free(target) || board.is_dead_square(target)) {
+				return;
+			}
+
+			position.move_box(index, target);
+			auto player = box;
+			macro_pushes.clear();
+			if (options.use_macros) {
+				player = macros.complete(position, index, direction, macro_pushes);
+				target = position.get_boxes()[index];
+			}
+
+			auto is_box = [&](Cell cell) { return position.is_box(cell); };
+			auto is_dead_pattern = [&]() { return options.pattern_database && options.pattern_database->is_dead(board, target, is_box); };
+			if (!is_freeze_deadlock(board, target, is_box) && !is_dead_pattern()) {
+				child_reachability.compute(position, player);
+				auto length = static_cast<std::uint32_t>(1 + macro_pushes.size());
+				visit(Push{box, direction}, length, child_reachability.normalized(), [&]() {
+					if (!is_matching_current) {
+						parent_boxes = position.get_boxes();
+						parent_boxes[index] = box;
+						matching.assign_all(parent_boxes);
+						is_matching_current = true;
+					}
+					child_matching = matching;
+					child_matching.move_box(index, target);
+					return child_matching.get_lower_bound();
+				});
+			}
+			position.move_box(index, box);
+		}
+
+	public:
+		SuccessorGenerator(const Board &_board, SolverOptions _options) :
+			board{_board},
+			options{_options},
+			macros{_board},
+			matching{_board},
+			child_matching{_board}
+		{}
+
+		[[nodiscard]] auto normalized_player(const Position &position) -> Cell {
+			reachability.compute(position, position.player);
+			return reachability.normalized();
+		}
+
+		//From scratch, for positions that are not the child of an expanded one. nullopt for deadlocks.
+		[[nodiscard]] auto lower_bound_of(const Position &position) -> std::optional<std::uint32_t> {
+			matching.assign_all(position.get_boxes());
+			is_matching_current = false;
+			return matching.get_lower_bound();
+		}
+
+		//Pushes stored by a search are only the first of each macro. Replays them from the initial position
+		//and fills in the rest.
+		[[nodiscard]] auto expand_macros(const std::vector<Push> &pushes) const -> std::vector<Push> {
+			return expand_macros(Position{board}, pushes);
+		}
+
+		//The same for a search that started elsewhere.
+		[[nodiscard]] auto expand_macros(Position replay, const std::vector<Push> &pushes) const -> std::vector<Push> {
+			auto expanded = std::vector<Push>{};
+			for (auto push : pushes) {
+				auto index = replay.index_of(push.box);
+				replay.move_box(index, board.neighbor(push.box, push.direction));
+				expanded.push_back(push);
+				if (options.use_macros) {
+					macros.complete(replay, index, push.direction, expanded);
+				}
+			}
+			return expanded;
+		}
+
+		//Calls visit(push, length, normalized_player, compute_lower_bound) for each child, `length` being the
+		//number of pushes including a macro. While visit runs, the position holds the child; compute_lower_bound()
+		//returns its bound, or nullopt for a deadlock.
+		template<typename Visit>
+		void for_each_child(Position &position, SolverStatistics &statistics, const Visit &visit) {
+			++statistics.expanded_nodes;
+
+			reachability.compute(position, position.player);
+			is_matching_current = false;
+
+			if (options.use_pi_corrals && corral_analysis.analyse(board, position, reachability)) {
+				++statistics.corral_prunings;
+				for (auto push : corral_analysis.get_pushes()) {
+					try_push(position, position.index_of(push.box), push.direction, visit);
+				}
+				return;
+			}
+
+			for (auto i = size_t{}; i < position.get_boxes().size(); ++i) {
+				auto box = position.get_boxes()[i];
+				for (auto direction : all_directions) {
+					if (reachability.contains(board.neighbor(box, opposite(direction)))) {
+						try_push(position, i, direction, visit);
+					}
+				}
+			}
+		}
+	};
+
+	//Best-first (A*) search over box pushes. States are box sets plus the normalized player cell,
+	//so the cost is the number of pushes and walks between pushes are free.
+	class Solver {
+	private:
+		struct Node {
+			std::uint64_t hash;
+			std::uint32_t parent;
+			std::uint32_t cost;
+			std::uint32_t lower_bound;
+			//Nodes with this one as their parent. Only nodes without any are forgotten.
+			std::uint32_t number_of_children;
+			Cell player;
+			Cell pushed_box;
+			Direction direction;
+			bool closed;
+			//Its slot is free for another node.
+			bool forgotten;
+		};
+
+		static constexpr auto no_parent = std::numeric_limits<std::uint32_t>::max();
+
+		const Board &board;
+		SolverOptions options;
+		size_t number_of_boxes;
+
+		std::vector<Node> nodes;
+		StatePacker packer;
+		//The states of the nodes, packer.bytes_per_state() bytes each.
+		std::vector<std::uint8_t> state_pool;
+		TranspositionTable table;
+		OpenList open;
+		//Slots of forgotten nodes, which add_node fills first.
+		std::vector<std::uint32_t> free_nodes;
+		size_t max_nodes = no_parent;
+
+		Position position;
+		SuccessorGenerator successors;
+		std::vector<std::uint8_t> packed_state;
+		std::vector<Cell> unpacked_boxes;
+
+		SolverStatistics statistics;
+
+		[[nodiscard]] auto state_of(std::uint32_t node) -> std::uint8_t * {
+			return state_pool.data() + static_cast<size_t>(node) * packed_state.size();
+		}
+
+		[[nodiscard]] auto state_of(std::uint32_t node) const -> const std::uint8_t * {
+			return state_pool.data() + static_cast<size_t>(node) * packed_state.size();
+		}
+
+		void insert_into_table(std::uint32_t index) {
+			auto hash_of = [&](std::uint32_t other) { return nodes[other].hash; };
+			auto eviction_score = [&](std::uint32_t other) {
+				if (options.replacement == Replacement::Oldest) {
+					return std::uint64_t{no_parent - other};
+				}
+				return std::uint64_t{nodes[other].cost} + std::uint64_t{options.weight} * nodes[other].lower_bound;
+			};
+			table.insert(nodes[index].hash, index, hash_of, eviction_score);
+		}
+
+		//Into the slot of a forgotten node if there is one, with the state in packed_state.
+		auto store_node(const Node &node) -> std::uint32_t {
+			auto index = std::uint32_t{};
+			if (free_nodes.empty()) {
+				index = static_cast<std::uint32_t>(nodes.size());
+				nodes.push_back(node);
+				state_pool.resize(state_pool.size() + packed_state.size());
+			} else {
+				index = free_nodes.back();
+				free_nodes.pop_back();
+				nodes[index] = node;
+			}
+			std::copy(RANGE(packed_state), state_of(index));
+			insert_into_table(index);
+			return index;
+		}
+
+		//Whether `count` more nodes fit into the memory limit, as nodes and as open entries.
+		[[nodiscard]] auto has_room_for(size_t count) const -> bool {
+			auto number_of_free_nodes = free_nodes.size() + (max_nodes > nodes.size() ? max_nodes - nodes.size() : 0);
+			return count <= number_of_free_nodes && open.size() + count <= max_nodes;
+		}
+
+		//Makes room under the memory limit. Drops the stale entries of the open list and forgets the open states
+		//without children among the worse half of it. Their parents are opened again, with the best estimate among
+		//the forgotten children, so they come back once the search gets that far. Works in place, as there is no
+		//memory left for anything else.
+		void forget() {
+			auto &entries = open.entries();
+			auto by_node = [](const OpenEntry &lhs, const OpenEntry &rhs) { return lhs.node != rhs.node ? lhs.node < rhs.node : rhs < lhs; };
+			auto same_node = [](const OpenEntry &lhs, const OpenEntry &rhs) { return lhs.node == rhs.node; };
+			std::erase_if(entries, [&](const OpenEntry &entry) {
+				const auto &node = nodes[entry.node];
+				return node.closed || node.cost != entry.cost;
+			});
+			//One entry per node, so none is left behind for the slot of a forgotten one.
+			std::sort(RANGE(entries), by_node);
+			entries.erase(std::unique(RANGE(entries), same_node), entries.end());
+			std::sort(RANGE(entries), [](const OpenEntry &lhs, const OpenEntry &rhs) { return rhs < lhs; });
+
+			//Chosen before any parent loses a child, so no parent is forgotten along with its children.
+			auto middle = entries.begin() + static_cast<ptrdiff_t>(entries.size() / 2);
+			for (auto it = middle; it != entries.end(); ++it) {
+				auto &node = nodes[it->node];
+				node.forgotten = node.number_of_children == 0 && node.parent != no_parent;
+			}
+			for (auto it = middle; it != entries.end(); ++it) {
+				auto &node = nodes[it->node];
+				if (!node.forgotten) {
+					continue;
+				}
+				node.closed = true;
+				table.erase(node.hash, it->node);
+				free_nodes.push_back(it->node);
+				++statistics.forgotten_states;
+				auto &parent = nodes[node.parent];
+				--parent.number_of_children;
+				*it = OpenEntry{it->estimate, parent.lower_bound, parent.cost, node.parent};
+			}
+
+			//Each parent once, with its best entry. One that is open already gets another entry anyway, the better
+			//one is popped first and closes it.
+			std::sort(middle, entries.end(), by_node);
+			entries.erase(std::unique(middle, entries.end(), same_node), entries.end());
+			for (auto it = middle; it != entries.end(); ++it) {
+				nodes[it->node].closed = false;
+			}
+			open.restore_heap();
+		}
+
+		//Stores the current position as a node, unless an equal state is already known with at most the same cost.
+		//The lower bound is only computed for new states; states without one are deadlocks and stay closed.
+		template<typename ComputeLowerBound>
+		void add_node(std::uint32_t parent, std::uint32_t cost, Cell player, Push push, const ComputeLowerBound &compute_lower_bound) {
+			++statistics.generated_nodes;
+
+			auto hash = position.get_box_hash() ^ board.player_key(player);
+			std::fill(RANGE(packed_state), std::uint8_t{});
+			packer.pack(position.get_boxes(), player, packed_state.data());
+
+			auto hash_of = [&](std::uint32_t index) { return nodes[index].hash; };
+			auto equal = [&](std::uint32_t index) { return std::equal(RANGE(packed_state), state_of(index)); };
+
+			if (auto maybe_existing = table.find(hash, hash_of, equal)) {
+				auto &existing = nodes[*maybe_existing];
+				if (existing.closed || existing.cost <= cost) {
+					return;
+				}
+				--nodes[existing.parent].number_of_children;
+				++nodes[parent].number_of_children;
+				existing.parent = parent;
+				existing.cost = cost;
+				existing.pushed_box = push.box;
+				existing.direction = push.direction;
+				open.push(OpenEntry{cost + options.weight * existing.lower_bound, existing.lower_bound, cost, *maybe_existing});
+				return;
+			}
+
+			if (parent != no_parent) {
+				++nodes[parent].number_of_children;
+			}
+			auto index = store_node(Node{hash, parent, cost, 0, 0, player, push.box, push.direction, false, false});
+			auto maybe_bound = compute_lower_bound();
+			if (!maybe_bound) {
+				nodes[index].closed = true;
+				return;
+			}
+			nodes[index].lower_bound = *maybe_bound;
+			open.push(OpenEntry{cost + options.weight * *maybe_bound, *maybe_bound, cost, index});
+		}
+
+		//Options that change what the stored nodes mean. The others may differ between a run and its resumption.
+		[[nodiscard]] auto checkpoint_flags() const -> std::uint8_t {
+			return static_cast<std::uint8_t>(options.use_macros | options.use_pi_corrals << 1);
+		}
+
+		//The nodes column by column and their states. Hashes, the node table and the open list follow from those.
+		void save_checkpoint() const {
+			auto writer = CheckpointWriter{*options.maybe_checkpoint_path};
+			writer.write(fingerprint(board));
+			writer.write(checkpoint_flags());
+			writer.write(std::uint64_t{nodes.size()});
+			writer.write(std::uint64_t{statistics.expanded_nodes});
+			writer.write(std::uint64_t{statistics.generated_nodes});
+			writer.write(std::uint64_t{statistics.corral_prunings});
+			writer.write(std::uint64_t{statistics.forgotten_states});
+			writer.write(statistics.seconds);
+
+			auto write_column = [&](auto field) {
+				auto column = std::vector<std::remove_cvref_t<decltype(nodes.front().*field)>>{};
+				column.reserve(nodes.size());
+				for (const auto &node : nodes) {
+					column.push_back(node.*field);
+				}
+				writer.write(column);
+			};
+			write_column(&Node::parent);
+			write_column(&Node::cost);
+			write_column(&Node::lower_bound);
+			write_column(&Node::player);
+			write_column(&Node::pushed_box);
+			auto flags = std::vector<std::uint8_t>{};
+			flags.reserve(nodes.size());
+			for (const auto &node : nodes) {
+				flags.push_back(static_cast<std::uint8_t>(static_cast<unsigned>(node.direction) | unsigned{node.closed} << 2 | unsigned{node.forgotten} << 3));
+			}
+			writer.write(flags);
+			writer.write(state_pool);
+			writer.commit();
+		}
+
+		//Throws std::runtime_error if the file is no checkpoint of this level and these options.
+		void load_checkpoint() {
+			auto reader = CheckpointReader{*options.maybe_checkpoint_path};
+			if (reader.read<std::uint64_t>() != fingerprint(board) || reader.read<std::uint8_t>() != checkpoint_flags()) {
+				throw std::runtime_error{options.maybe_checkpoint_path->string() + " belongs to another level or other options."};
+			}
+			auto number_of_nodes = reader.read<std::uint64_t>();
+			statistics.expanded_nodes = reader.read<std::uint64_t>();
+			statistics.generated_nodes = reader.read<std::uint64_t>();
+			statistics.corral_prunings = reader.read<std::uint64_t>();
+			statistics.forgotten_states = reader.read<std::uint64_t>();
+			statistics.seconds = reader.read<double>();
+
+			auto parents = reader.read<std::uint32_t>(number_of_nodes);
+			auto costs = reader.read<std::uint32_t>(number_of_nodes);
+			auto lower_bounds = reader.read<std::uint32_t>(number_of_nodes);
+			auto players = reader.read<Cell>(number_of_nodes);
+			auto pushed_boxes = reader.read<Cell>(number_of_nodes);
+			auto flags = reader.read<std::uint8_t>(number_of_nodes);
+			state_pool = reader.read<std::uint8_t>(number_of_nodes * packed_state.size());
+
+			nodes.clear();
+			nodes.reserve(number_of_nodes);
+			for (auto index = std::uint32_t{}; index < number_of_nodes; ++index) {
+				auto closed = (flags[index] & 4) != 0;
+				auto forgotten = (flags[index] & 8) != 0;
+				auto hash = std::uint64_t{};
+				if (!forgotten) {
+					hash = board.player_key(packer.unpack(state_of(index), unpacked_boxes.data()));
+					for (auto box : unpacked_boxes) {
+						hash ^= board.box_key(box);
+					}
+				}
+				nodes.push_back(Node{hash, parents[index], costs[index], lower_bounds[index], 0, players[index], pushed_boxes[index], static_cast<Direction>(flags[index] & 3), closed, forgotten});
+
+				if (forgotten) {
+					free_nodes.push_back(index);
+					continue;
+				}
+				//Stored states are distinct, so none is in the table yet.
+				insert_into_table(index);
+				if (!closed) {
+					open.push(OpenEntry{costs[index] + options.weight * lower_bounds[index], lower_bounds[index], costs[index], index});
+				}
+			}
+			for (const auto &node : nodes) {
+				if (!node.forgotten && node.parent != no_parent) {
+					++nodes[node.parent].number_of_children;
+				}
+			}
+		}
+
+		[[nodiscard]] auto reconstruct(std::uint32_t node) const -> std::optional<std::string> {
+			auto pushes = std::vector<Push>{};
+			for (; nodes[node].parent != no_parent; node = nodes[node].parent) {
+				pushes.push_back(Push{nodes[node].pushed_box, nodes[node].direction});
+			}
+			std::reverse(RANGE(pushes));
+			return pushes_to_lurd(board, successors.expand_macros(pushes));
+		}
+
+	public:
+		Solver(const Board &_board, SolverOptions _options = {}) :
+			board{_board},
+			options{_options},
+			number_of_boxes{_board.get_initial_boxes().size()},
+			packer{_board},
+			table{_options.maybe_memory_limit ? *_options.maybe_memory_limit / 4 : std::numeric_limits<size_t>::max()},
+			position{_board},
+			successors{_board, _options},
+			packed_state(packer.bytes_per_state()),
+			unpacked_boxes(number_of_boxes)
+		{
+			//Reserved up front, so growing never holds two copies at once.
+			if (options.maybe_memory_limit) {
+				auto bytes_per_node = sizeof(Node) + packed_state.size() + sizeof(OpenEntry) + sizeof(std::uint32_t);
+				max_nodes = std::min(max_nodes, (*options.maybe_memory_limit - *options.maybe_memory_limit / 4) / bytes_per_node);
+				nodes.reserve(max_nodes);
+				state_pool.reserve(max_nodes * packed_state.size());
+				open.reserve(max_nodes);
+				free_nodes.reserve(max_nodes);
+			}
+		}
+
+		[[nodiscard]] auto run() -> SolverResult {
+			auto start = std::chrono::steady_clock::now();
+			auto result = SolverResult{};
+
+			if (options.maybe_checkpoint_path && stdc::fs::exists(*options.maybe_checkpoint_path)) {
+				load_checkpoint();
+			} else {
+				add_node(no_parent, 0, successors.normalized_player(position), Push{no_cell, Direction::Up}, [&]() {
+					return successors.lower_bound_of(position);
+				});
+			}
+			auto previous_seconds = statistics.seconds;
+			auto update_seconds = [&](std::chrono::steady_clock::time_point now) {
+				statistics.seconds = previous_seconds + std::chrono::duration<double>(now - start).count();
+			};
+
+			auto last_checkpoint = start;
+			auto save_checkpoint_if_due = [&]() {
+				if (!options.maybe_checkpoint_path || statistics.expanded_nodes % 1024 != 0) {
+					return;
+				}
+				if (auto now = std::chrono::steady_clock::now(); now >= last_checkpoint + options.checkpoint_interval) {
+					statistics.stored_states = nodes.size() - free_nodes.size();
+					update_seconds(now);
+					save_checkpoint();
+					last_checkpoint = now;
+				}
+			};
+
+			auto should_stop = [&, deadline = options.maybe_time_limit ? std::optional{start + *options.maybe_time_limit} : std::nullopt]() {
+				//Reading the clock is cheap, but not free next to an expansion.
+				if (statistics.expanded_nodes % 1024 != 0) {
+					return false;
+				}
+				return options.stop_token.stop_requested() || (deadline && std::chrono::steady_clock::now() >= *deadline);
+			};
+
+			//An expansion adds at most one node per box and direction.
+			auto max_children = 4 * number_of_boxes;
+			while (!open.empty() && statistics.expanded_nodes < options.max_expanded_nodes && !should_stop()) {
+				save_checkpoint_if_due();
+				if (!has_room_for(max_children)) {
+					forget();
+					if (!has_room_for(max_children)) {
+						break;
+					}
+				}
+				auto entry = open.top();
+				open.pop();
+
+				auto &node = nodes[entry.node];
+				if (node.closed || node.cost != entry.cost) {
+					continue;
+				}
+				node.closed = true;
+
+				[[maybe_unused]] auto unpacked_player = packer.unpack(state_of(entry.node), unpacked_boxes.data());
+				assert(unpacked_player == node.player);
+				position.load(unpacked_boxes, node.player);
+				auto reaches_player_goal = [&]() {
+					return !options.maybe_player_goal || find_player_path(board, position.get_occupied(), position.player, *options.maybe_player_goal);
+				};
+				if (position.is_solved() && reaches_player_goal()) {
+					result.solution = reconstruct(entry.node);
+					break;
+				}
+
+				auto cost = node.cost;
+				successors.for_each_child(position, statistics, [&](Push push, std::uint32_t length, Cell player, const auto &compute_lower_bound) {
+					add_node(entry.node, cost + length, player, push, compute_lower_bound);
+				});
+			}
+
+			//Macros skip positions, so running out of them proves nothing.
+			result.proven_unsolvable = !result.solution && open.empty() && !options.use_macros;
+
+			statistics.stored_states = nodes.size() - free_nodes.size();
+			update_seconds(std::chrono::steady_clock::now());
+			if (options.maybe_checkpoint_path) {
+				if (result.solution || result.proven_unsolvable) {
+					stdc::fs::remove(*options.maybe_checkpoint_path);
+				} else {
+					save_checkpoint();
+				}
+			}
+			result.statistics = statistics;
+			return result;
+		}
+	};
+
+	//Solves a level headlessly. Throws std::invalid_argument if the level is malformed.
+	[[nodiscard]] inline auto solve(Level level, SolverOptions options = {}) -> SolverResult {
+		auto board = Board{level};
+		return Solver{board, options}.run();
+	}
+
+} //namespace sstm
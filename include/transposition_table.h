@@ -0,0 +1,204 @@
+#pragma once
+
+#include "board.h"
+#include "position.h"
+
+#include <cool/algorithm.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace sstm {
+
+	//Packs a state into a bitset of the cells a box can stand on, followed by the index of the player cell among
+	//the floor cells. Dead squares are left out unless a box starts there, no push ever leads onto one.
+	class StatePacker {
+	private:
+		static constexpr auto no_bit = std::numeric_limits<std::uint16_t>::max();
+
+		std::vector<std::uint16_t> bits_of_cells;
+		std::vector<Cell> box_cells;
+		std::vector<std::uint16_t> player_indices;
+		std::vector<Cell> player_cells;
+		size_t player_width = 1;
+		size_t size = 0;
+
+	public:
+		explicit StatePacker(const Board &board) :
+			bits_of_cells(board.number_of_cells(), no_bit),
+			player_indices(board.number_of_cells(), no_bit)
+		{
+			const auto &initial_boxes = board.get_initial_boxes();
+			for (auto cell = Cell{}; cell < board.number_of_cells(); ++cell) {
+				//A box the player cannot reach is sealed in as a wall, but it still stands there.
+				auto is_initial_box = std::find(RANGE(initial_boxes), cell) != initial_boxes.end();
+				if (!board.is_wall(cell)) {
+					player_indices[cell] = static_cast<std::uint16_t>(player_cells.size());
+					player_cells.push_back(cell);
+				}
+				if (is_initial_box || (!board.is_wall(cell) && !board.is_dead_square(cell))) {
+					bits_of_cells[cell] = static_cast<std::uint16_t>(box_cells.size());
+					box_cells.push_back(cell);
+				}
+			}
+			player_width = std::max(size_t{1}, size_t{std::bit_width(player_cells.size() - 1)});
+			size = (box_cells.size() + player_width + 7) / 8;
+		}
+
+		[[nodiscard]] auto bytes_per_state() const { return size; }
+
+		//Into bytes_per_state() bytes that are all zero.
+		void pack(const std::vector<Cell> &boxes, Cell player, std::uint8_t *destination) const {
+			for (auto box : boxes) {
+				auto bit = bits_of_cells[box];
+				assert(bit != no_bit);
+				destination[bit / 8] |= static_cast<std::uint8_t>(1u << bit % 8);
+			}
+			auto index = player_indices[player];
+			assert(index != no_bit);
+			for (auto i = size_t{}; i < player_width; ++i) {
+				auto bit = box_cells.size() + i;
+				destination[bit / 8] |= static_cast<std::uint8_t>((unsigned{index} >> i & 1u) << bit % 8);
+			}
+		}
+
+		//Writes the boxes in ascending order, the same as Position::store_sorted, and returns the player cell.
+		[[nodiscard]] auto unpack(const std::uint8_t *source, Cell *boxes) const -> Cell {
+			auto number_of_box_bytes = (box_cells.size() + 7) / 8;
+			for (auto byte = size_t{}; byte < number_of_box_bytes; ++byte) {
+				auto bits = static_cast<unsigned>(source[byte]);
+				if (byte + 1 == number_of_box_bytes && box_cells.size() % 8) {
+					bits &= (1u << box_cells.size() % 8) - 1;
+				}
+				for (; bits; bits &= bits - 1) {
+					*boxes++ = box_cells[byte * 8 + static_cast<size_t>(std::countr_zero(bits))];
+				}
+			}
+			auto index = size_t{};
+			for (auto i = size_t{}; i < player_width; ++i) {
+				auto bit = box_cells.size() + i;
+				index |= size_t{static_cast<unsigned>(source[bit / 8] >> bit % 8) & 1u} << i;
+			}
+			return player_cells[index];
+		}
+	};
+
+	//Which entry a full bucket of a TranspositionTable gives up.
+	enum class Replacement : std::uint8_t {
+		//The state stored first, as its node has the smallest index.
+		Oldest,
+		//The state with the highest cost plus lower bound, the one a best-first search is least likely to come back to.
+		Furthest,
+	};
+
+	//Set of node indices in buckets of one cache line each. Like NodeTable, hashing and equality are left to the
+	//caller, which owns the states. The table doubles as long as the old and the new buckets fit into `memory_limit`
+	//bytes together. From then on a full bucket evicts the entry the caller rates worst, so the search only loses
+	//track of that duplicate.
+	class TranspositionTable {
+	private:
+		static constexpr auto empty = std::numeric_limits<std::uint32_t>::max();
+		static constexpr auto entries_per_bucket = size_t{8};
+
+		struct Entry {
+			//The high half of the hash, the low half picks the bucket.
+			std::uint32_t tag = 0;
+			std::uint32_t index = empty;
+		};
+
+		struct alignas(64) Bucket {
+			std::array<Entry, entries_per_bucket> entries{};
+		};
+
+		std::vector<Bucket> buckets = std::vector<Bucket>(1 << 10);
+		size_t max_buckets;
+		size_t size = 0;
+		size_t evictions = 0;
+
+		[[nodiscard]] static auto tag_of(std::uint64_t hash) { return static_cast<std::uint32_t>(hash >> 32); }
+
+		[[nodiscard]] auto bucket_of(std::uint64_t hash) -> Bucket & { return buckets[hash & (buckets.size() - 1)]; }
+		[[nodiscard]] auto bucket_of(std::uint64_t hash) const -> const Bucket & { return buckets[hash & (buckets.size() - 1)]; }
+
+		template<typename HashOf>
+		void grow(const HashOf &hash_of) {
+			auto old_buckets = std::exchange(buckets, std::vector<Bucket>(buckets.size() * 2));
+			for (const auto &old_bucket : old_buckets) {
+				for (auto entry : old_bucket.entries) {
+					if (entry.index == empty) {
+						continue;
+					}
+					//Each old bucket splits into two, so the entries always fit.
+					auto &bucket = bucket_of(hash_of(entry.index));
+					*std::find_if(RANGE(bucket.entries), [](Entry free) { return free.index == empty; }) = entry;
+				}
+			}
+		}
+
+	public:
+		explicit TranspositionTable(size_t memory_limit = std::numeric_limits<size_t>::max()) :
+			max_buckets{std::max(size_t{1} << 10, std::bit_floor(memory_limit / sizeof(Bucket) / 3 * 2))}
+		{
+			buckets.resize(std::min(buckets.size(), max_buckets));
+		}
+
+		template<typename HashOf, typename Equal>
+		[[nodiscard]] auto find(std::uint64_t hash, const HashOf &hash_of, const Equal &equal) const -> std::optional<std::uint32_t> {
+			auto tag = tag_of(hash);
+			for (auto entry : bucket_of(hash).entries) {
+				if (entry.index != empty && entry.tag == tag && hash_of(entry.index) == hash && equal(entry.index)) {
+					return entry.index;
+				}
+			}
+			return std::nullopt;
+		}
+
+		//For a state not in the table. If its bucket is full and the table cannot grow anymore, the entry with the
+		//highest eviction_score(index) makes room.
+		template<typename HashOf, typename EvictionScore>
+		void insert(std::uint64_t hash, std::uint32_t index, const HashOf &hash_of, const EvictionScore &eviction_score) {
+			//Buckets fill unevenly, so the table grows well before it is full on average.
+			if (2 * (size + 1) > buckets.size() * entries_per_bucket && buckets.size() < max_buckets) {
+				grow(hash_of);
+			}
+
+			auto is_free = [](Entry entry) { return entry.index == empty; };
+			auto *entries = &bucket_of(hash).entries;
+			auto it = std::find_if(RANGE(*entries), is_free);
+			while (it == entries->end() && buckets.size() < max_buckets) {
+				grow(hash_of);
+				entries = &bucket_of(hash).entries;
+				it = std::find_if(RANGE(*entries), is_free);
+			}
+			if (it == entries->end()) {
+				it = std::max_element(RANGE(*entries), [&](Entry lhs, Entry rhs) { return eviction_score(lhs.index) < eviction_score(rhs.index); });
+				++evictions;
+				--size;
+			}
+			*it = Entry{tag_of(hash), index};
+			++size;
+		}
+
+		//Does nothing if the index was evicted before.
+		void erase(std::uint64_t hash, std::uint32_t index) {
+			for (auto &entry : bucket_of(hash).entries) {
+				if (entry.index == index) {
+					entry = Entry{};
+					--size;
+					return;
+				}
+			}
+		}
+
+		[[nodiscard]] auto get_size() const { return size; }
+		[[nodiscard]] auto get_evictions() const { return evictions; }
+	};
+
+} //namespace sstm
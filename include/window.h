@@ -12,6 +12,7 @@
 #include <memory>
 #include <cmath>
 #include <string_view>
+#include <utility>
 
 #include "text_renderer.h"
 
@@ -150,10 +151,49 @@ namespace sstm {
 				window.mouse_tracked = false;
 				window.last_mouse_position_set = false;
 			}
-			if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+			if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
 				glfwSetInputMode(handle, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 				window.mouse_tracked = true;
 			}
+			if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !window.mouse_tracked) {
+				auto [origin, direction] = window.cursor_ray();
+				if (auto maybe_pos = window.world_ptr->pick(origin, direction)) {
+					window.world_ptr->click(*maybe_pos);
+				}
+			}
+		}
+
+		//From the camera through the cursor, in world coordinates.
+		[[nodiscard]] auto cursor_ray() const -> std::pair<glm::vec3, glm::vec3> {
+			auto cursor_x = 0.;
+			auto cursor_y = 0.;
+			glfwGetCursorPos(handle, &cursor_x, &cursor_y);
+
+			//Cursor positions are in screen coordinates, which differ from pixels on high DPI screens.
+			auto window_width = 0;
+			auto window_height = 0;
+			glfwGetWindowSize(handle, &window_width, &window_height);
+			auto framebuffer_width = 0;
+			auto framebuffer_height = 0;
+			glfwGetFramebufferSize(handle, &framebuffer_width, &framebuffer_height);
+			auto x = static_cast<float>(cursor_x * framebuffer_width / std::max(window_width, 1));
+			auto y = static_cast<float>(framebuffer_height - cursor_y * framebuffer_height / std::max(window_height, 1));
+
+			auto viewport_data = std::array<GLint, 4>{};
+			glGetIntegerv(GL_VIEWPORT, viewport_data.data());
+			auto viewport = glm::vec4{
+				static_cast<float>(viewport_data[0]),
+				static_cast<float>(viewport_data[1]),
+				static_cast<float>(viewport_data[2]),
+				static_cast<float>(viewport_data[3])
+			};
+
+			//Same as in render.
+			glm::mat4 projection = glm::infinitePerspective(world_ptr->fov_vert, viewport[2] / viewport[3], 0.1f);
+			glm::mat4 view = world_ptr->camera.GetCurrentViewMatrix();
+			auto near_point = glm::unProject(glm::vec3{x, y, 0.f}, view, projection, viewport);
+			auto far_point = glm::unProject(glm::vec3{x, y, .5f}, view, projection, viewport);
+			return {near_point, far_point - near_point};
 		}
 
 		static void key_callback(GLFWwindow *handle, int key, int, int action, int mods) {
@@ -178,6 +218,9 @@ namespace sstm {
 			if (key == GLFW_KEY_R && action == GLFW_PRESS) {
 				window.world_ptr->reload_level();
 			}
+			if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+				window.world_ptr->request_hint();
+			}
 			if (key == GLFW_KEY_PAGE_UP && action == GLFW_PRESS) {
 				window.world_ptr->load_next_level();
 			}
@@ -279,6 +322,11 @@ namespace sstm {
 						model = glm::translate(model, -aabb.min);
 						
 						world_ptr->shader.setMat4("model", model);
+
+						auto is_dead_ground = world_ptr->is_dead_ground(glm::ivec3{x, y, z});
+						auto is_hinted_box = world_ptr->is_hinted_box(glm::ivec3{x, y, z});
+						auto is_selected_box = world_ptr->is_selected_box(glm::ivec3{x, y, z});
+						world_ptr->shader.setVec3("tint", is_dead_ground ? glm::vec3{1.f, .45f, .45f} : is_selected_box ? glm::vec3{1.f, .85f, .4f} : is_hinted_box ? glm::vec3{.55f, .75f, 1.f} : glm::vec3{1.f, 1.f, 1.f});
 			
 						model_3d.Draw(world_ptr->shader);
 					}
@@ -297,7 +345,15 @@ namespace sstm {
 			auto t_x = 0.024f * width;
 			auto t_y = 0.02f * width;
 			
-		text_renderer.render_text(world_ptr->text_shader, std::to_string(world_ptr->next_turn_id) + "/" + std::to_string(world_ptr->high_scores[world_ptr->loaded_level_id]), t_x, t_y, /*scale*/ 1, glm::vec3(0.5, 0.8f, 0.2f));
+		text_renderer.render_text(world_ptr->text_shader, std::to_string(world_ptr->number_of_moves()) + "/" + std::to_string(world_ptr->high_scores[world_ptr->loaded_level_id]), t_x, t_y, /*scale*/ 1, glm::vec3(0.5, 0.8f, 0.2f));
+
+			if (world_ptr->is_deadlocked()) {
+				text_renderer.render_text(world_ptr->text_shader, "Deadlock", t_x, t_y + 0.04f * width, /*scale*/ 1, glm::vec3(0.9f, 0.2f, 0.2f));
+			}
+
+			if (auto maybe_hint_text = world_ptr->hint_text()) {
+				text_renderer.render_text(world_ptr->text_shader, *maybe_hint_text, t_x, t_y + 0.08f * width, /*scale*/ 1, glm::vec3(0.55f, 0.75f, 1.f));
+			}
 		
 
 			//show what we got.
@@ -15,6 +15,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/optional.hpp>
 #include <boost/serialization/string.hpp>
+#include <boost/serialization/version.hpp>
 
 #include <cool/WATCH.h>
 #include <cool/literals.h>
@@ -28,12 +29,22 @@
 #include "model.h"
 #include "sokoban_parser.h"
 #include "camera.h"
-
+#include "board.h"
+#include "deadlock.h"
+#include "deadlock_patterns.h"
+#include "hint_engine.h"
+#include "push_planner.h"
+#include "solution_optimizer.h"
+
+#include <array>
+#include <chrono>
 #include <cmath>
 #include <vector>
 #include <unordered_map>
 #include <optional>
 #include <stack>
+#include <string>
+#include <thread>
 
 namespace sstm {
 	
@@ -62,7 +73,7 @@ namespace sstm {
 		Shader shader;
 		Shader text_shader;
 
-		std::vector<Level> levels;
+		LevelIndex levels;
 		size_t loaded_level_id;
 
 		size_t number_of_steps;
@@ -73,10 +84,25 @@ namespace sstm {
 
 		std::vector<glm::ivec3> goal_positions;
 
+		//Static analysis of the loaded level, if it is well-formed enough for one.
+		std::optional<Board> maybe_board;
+		//Shared by the deadlock warnings and the hints of all levels, and kept across runs.
+		PatternDatabase deadlock_patterns{stdc::fs::path{"saves"} / "deadlock_patterns"};
+		//Searches the loaded level in the background, see request_hint.
+		std::optional<HintEngine> maybe_hints;
+		std::chrono::milliseconds hint_budget{16};
+		//Hints are shown from the first request until another level is loaded.
+		bool are_hints_shown = false;
+		std::optional<Hint> maybe_hint;
+		//Picked by a click, the next click on a free cell pushes it there, see click.
+		std::optional<glm::ivec3> maybe_selected_box;
+
 		Camera camera;
 		float fov_vert = glm::radians(60.f);
 
 		std::vector<size_t> high_scores;
+		//Shortens solved levels in the background, see collect_optimized_solutions.
+		BackgroundOptimizer optimizer{std::max(std::thread::hardware_concurrency(), 2u) - 1};
 
 		
 		[[nodiscard]] const auto &entity_at(const glm::ivec3 &pos) const {
@@ -88,6 +114,95 @@ namespace sstm {
 			return stdc::as_mutable(std::as_const(*this).entity_at(pos));
 		}
 
+		[[nodiscard]] auto to_cell(const glm::ivec3 &pos) const -> Cell {
+			assert(maybe_board);
+			return maybe_board->cell_at(grid.size() - 1 - static_cast<size_t>(pos.x), static_cast<size_t>(pos.z));
+		}
+
+		//Only looks at x and z, so it can be asked for the ground below a cell as well.
+		[[nodiscard]] auto is_dead_square(const glm::ivec3 &pos) const -> bool {
+			return maybe_board && maybe_board->is_dead_square(to_cell(pos));
+		}
+
+		[[nodiscard]] auto is_dead_ground(const glm::ivec3 &pos) const -> bool {
+			return entity_at(pos) == Entity::Ground && is_dead_square(pos);
+		}
+
+		[[nodiscard]] auto to_pos(Cell cell) const -> glm::ivec3 {
+			assert(maybe_board);
+			return glm::ivec3{grid.size() - 1 - maybe_board->row_of(cell), 1, maybe_board->column_of(cell)};
+		}
+
+		[[nodiscard]] auto is_box_at(Cell cell) const -> bool {
+			auto pos = to_pos(cell);
+			return is_in_bounds(pos) && entity_at(pos) == Entity::Box;
+		}
+
+		//Some box is on a dead square or frozen off its goal.
+		[[nodiscard]] auto is_deadlocked() const -> bool {
+			using namespace stdc::literals;
+			if (!maybe_board) {
+				return false;
+			}
+
+			auto is_box = [&](Cell cell) { return is_box_at(cell); };
+			for (auto x = 0_z; x < grid.size(); ++x) {
+				const auto &row = grid[x][1];
+				for (auto z = 0_z; z < row.size(); ++z) {
+					auto box = to_cell(glm::ivec3{x, 1, z});
+					if (row[z] == Entity::Box && (is_deadlocked_box(*maybe_board, box, is_box) || deadlock_patterns.is_dead(*maybe_board, box, is_box))) {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		//The turns up to next_turn_id in LURD notation, the format of the solver and the optimizer.
+		[[nodiscard]] auto turns_to_lurd() const -> std::string {
+			auto lurd = std::string{};
+			for (auto i = size_t{}; i < next_turn_id; ++i) {
+				lurd += turns[i].to_lurd();
+			}
+			return lurd;
+		}
+
+		//Turns can bundle several moves, so this is what the player is scored on rather than next_turn_id.
+		[[nodiscard]] auto number_of_moves() const -> size_t {
+			auto moves = size_t{};
+			for (auto i = size_t{}; i < next_turn_id; ++i) {
+				moves += turns[i].number_of_moves();
+			}
+			return moves;
+		}
+
+		[[nodiscard]] auto is_hinted_box(const glm::ivec3 &pos) const -> bool {
+			return maybe_hint && maybe_hint->maybe_push && to_pos(maybe_hint->maybe_push->box) == pos;
+		}
+
+		[[nodiscard]] auto is_selected_box(const glm::ivec3 &pos) const -> bool {
+			return maybe_selected_box == pos && entity_at(pos) == Entity::Box;
+		}
+
+		[[nodiscard]] auto hint_text() const -> std::optional<std::string> {
+			if (!are_hints_shown) {
+				return std::nullopt;
+			}
+			if (!maybe_hint) {
+				return "Hint: thinking...";
+			}
+			if (!maybe_hint->maybe_push) {
+				return "Hint: no solution from here";
+			}
+			auto direction_names = std::array{"up", "down", "left", "right"};
+			auto text = "Hint: push " + std::string{direction_names[static_cast<size_t>(maybe_hint->maybe_push->direction)]};
+			if (maybe_hint->maybe_remaining_pushes) {
+				text += maybe_hint->is_optimal ? ", " : ", at most ";
+				text += std::to_string(*maybe_hint->maybe_remaining_pushes) + " pushes to go";
+			}
+			return text;
+		}
+
 		[[nodiscard]] auto satisfies_goal_condition() const -> bool {
 			return std::all_of(RANGE(goal_positions), [&](const auto &goal_pos) {
 				return entity_at(goal_pos) == Entity::Box;
@@ -105,8 +220,9 @@ namespace sstm {
 
 			number_of_steps = 0;
 
-			const auto &level = levels[level_id];
-			grid = std::vector(level.size(), std::vector<std::vector<Entity>>(2));
+			const auto level_store = levels.get(level_id);
+			const auto level = level_store[0];
+			grid = std::vector(level.get_height(), std::vector<std::vector<Entity>>(2));
 
 			auto error_pos =  glm::ivec3{-1, -1, -1};;
 			controlled_pos = error_pos;
@@ -117,18 +233,17 @@ namespace sstm {
 
 			auto max_z = 0_z;
 
-			for (auto x = 0_z; x < level.size(); ++x) {
-				const auto &row = level[level.size() - x - 1]; //TODO
-				stdc::maximize(max_z, row.size());
+			for (auto x = 0_z; x < level.get_height(); ++x) {
+				const auto r = level.get_height() - x - 1; //TODO
+				stdc::maximize(max_z, level.get_width());
 				
 				auto &grid_row_below = grid[x][y_below];
 				auto &grid_row_above = grid[x][y_above];
 				
-				grid_row_below.reserve(row.size());
-				grid_row_above.reserve(row.size());		
-				auto z = 0_z;
-				for (auto piece: row) {
-					switch (piece) {
+				grid_row_below.reserve(level.get_width());
+				grid_row_above.reserve(level.get_width());		
+				for (auto z = 0_z; z < level.get_width(); ++z) {
+					switch (level.at(r, z)) {
 						case SokobanPiece::Wall:
 							grid_row_below.push_back(Entity::Wall);
 							grid_row_above.push_back(Entity::Wall);
@@ -178,8 +293,6 @@ namespace sstm {
 
 						default: assert(false);
 					}
-
-					++z;
 				} //for z
 			} //for x
 			
@@ -206,8 +319,62 @@ namespace sstm {
 			assert(controlled_pos != error_pos);
 			assert(!satisfies_goal_condition());
 
+			try {
+				maybe_board = Board{level};
+				//Macros get to a hint sooner, at the price of hints that never claim the fewest pushes.
+				maybe_hints.emplace(*maybe_board, SolverOptions{.max_expanded_nodes = 2'000'000, .use_macros = true, .pattern_database = &deadlock_patterns});
+			} catch (std::invalid_argument &e) {
+				std::cout << "No dead square analysis for level " << level_id << ": " << e.what() << '\n';
+				maybe_board = std::nullopt;
+				maybe_hints = std::nullopt;
+			}
+
 			turns.clear();
 			next_turn_id = 0;
+
+			are_hints_shown = false;
+			maybe_hint = std::nullopt;
+			maybe_selected_box = std::nullopt;
+			update_hint_search();
+		}
+
+		//Tells the hint engine about the current state, which interrupts its search for the previous one. Until hints
+		//are asked for, the engine is left idle rather than keep a core busy for nothing.
+		void update_hint_search() {
+			using namespace stdc::literals;
+			if (!maybe_hints || !are_hints_shown) {
+				return;
+			}
+
+			auto boxes = std::vector<Cell>{};
+			for (auto x = 0_z; x < grid.size(); ++x) {
+				const auto &row = grid[x][1];
+				for (auto z = 0_z; z < row.size(); ++z) {
+					if (row[z] == Entity::Box) {
+						boxes.push_back(to_cell(glm::ivec3{x, 1, z}));
+					}
+				}
+			}
+			maybe_hints->set_state(std::move(boxes), to_cell(controlled_pos));
+		}
+
+		//Shows hints from now on. Waits at most hint_budget for the first one, later ones arrive through refresh_hint.
+		void request_hint() {
+			if (!maybe_hints) {
+				std::cout << "No hints for this level.\n";
+				return;
+			}
+			are_hints_shown = true;
+			update_hint_search();
+			maybe_hint = maybe_hints->wait_for_hint(hint_budget);
+			std::cout << *hint_text() << ".\n";
+		}
+
+		//Called once per frame, so the shown hint improves while the player thinks.
+		void refresh_hint() {
+			if (are_hints_shown && maybe_hints) {
+				maybe_hint = maybe_hints->get_hint();
+			}
 		}
 
 		[[nodiscard]] auto serialize_level_state() const {
@@ -358,8 +525,8 @@ namespace sstm {
 			
 			maybe_models.try_emplace(Entity::Nothing);
 			
-			levels = parse_collection("/home/jgr/Downloads/level/Homz _Challenge/Homz Challenge.txt");
-			std::cout << "Parsed levels: " << levels.size() << ".\n";
+			levels = LevelIndex{"/home/jgr/Downloads/level/Homz _Challenge/Homz Challenge.txt"};
+			std::cout << "Indexed levels: " << levels.size() << ".\n";
 
 			deserialize_high_scores();
 
@@ -375,6 +542,11 @@ namespace sstm {
 		constexpr auto operator=(This &&) &noexcept-> World & = delete;
 		~World() {
 			serialize_high_scores();
+			try {
+				deadlock_patterns.save();
+			} catch (std::runtime_error &e) {
+				std::cout << e.what() << '\n';
+			}
 		}
 
 		[[nodiscard]] auto is_in_bounds(const glm::ivec3 &pos) const -> bool {
@@ -386,15 +558,28 @@ namespace sstm {
 		void check_goals() {
 			if (satisfies_goal_condition()) {
 				//TODO
-				if (high_scores[loaded_level_id] > next_turn_id) {
-					std::cout << "New high score! " << next_turn_id << " instead of " << high_scores[loaded_level_id] << ".\n";
+				auto moves = number_of_moves();
+				if (high_scores[loaded_level_id] > moves) {
+					std::cout << "New high score! " << moves << " instead of " << high_scores[loaded_level_id] << ".\n";
 				}
-				stdc::minimize(high_scores[loaded_level_id], next_turn_id);
+				stdc::minimize(high_scores[loaded_level_id], moves);
+				optimizer.submit(loaded_level_id, levels.get(loaded_level_id)[0], turns_to_lurd());
 				--next_turn_id;
 				load_next_level();
 			}
 		}
 
+		//Called once per frame, so the optimizer threads never touch the high scores themselves.
+		void collect_optimized_solutions() {
+			for (const auto &optimized : optimizer.collect()) {
+				auto moves = optimized.solution.size();
+				if (high_scores[optimized.level_id] > moves) {
+					std::cout << "Optimized solution of level " << optimized.level_id << ": " << moves << " moves instead of " << high_scores[optimized.level_id] << ".\n";
+				}
+				stdc::minimize(high_scores[optimized.level_id], moves);
+			}
+		}
+
 		class Change {
 		public:
 			glm::ivec3 pos;
@@ -443,13 +628,18 @@ namespace sstm {
 			std::vector<Change> changes{};
 			glm::ivec3 controlled_pos_before{};
 			glm::ivec3 controlled_pos_after{};
+			//The moves of a turn that bundles several, like a planned push. Empty for a single step.
+			std::string lurd{};
 
 		public:
 			template<class Archive>
-			void serialize(Archive &ar, const unsigned int) {
+			void serialize(Archive &ar, const unsigned int version) {
 				ar & changes;
 				ar & controlled_pos_before;
 				ar & controlled_pos_after;
+				if (version > 0) {
+					ar & lurd;
+				}
 			}
 		
 			Turn() = default; //TODO: Serialization needs this? whä
@@ -457,11 +647,13 @@ namespace sstm {
 			Turn(
 				std::vector<Change> _changes,
 				glm::ivec3 _controlled_pos_before,
-				glm::ivec3 _controlled_pos_after
+				glm::ivec3 _controlled_pos_after,
+				std::string _lurd = {}
 			) :
 				changes{std::move(_changes)},
 				controlled_pos_before{_controlled_pos_before},
-				controlled_pos_after{_controlled_pos_after}
+				controlled_pos_after{_controlled_pos_after},
+				lurd{std::move(_lurd)}
 			{
 				[[maybe_unused]] auto change_to_pos = [](const auto &change) -> const auto & {
 					return change.pos;
@@ -471,7 +663,8 @@ namespace sstm {
 					stdc::transform_iterator{changes.end(), change_to_pos}
 				));
 
-				assert(controlled_pos_before != controlled_pos_after);
+				//A bundle of moves may well lead the player back to where it started.
+				assert(!lurd.empty() || controlled_pos_before != controlled_pos_after);
 			}
 
 			using const_iterator = decltype(changes)::const_iterator;
@@ -486,6 +679,20 @@ namespace sstm {
 				return controlled_pos_after;
 			}
 
+			[[nodiscard]] auto to_lurd() const -> std::string {
+				if (!lurd.empty()) {
+					return lurd;
+				}
+				auto translation = controlled_pos_after - controlled_pos_before;
+				auto direction = translation.x > 0 ? Direction::Up : translation.x < 0 ? Direction::Down : translation.z < 0 ? Direction::Left : Direction::Right;
+				auto is_push = std::any_of(RANGE(changes), [](const Change &change) { return change.get_after() == Entity::Box; });
+				return std::string(1, sstm::to_lurd(direction, is_push));
+			}
+
+			[[nodiscard]] auto number_of_moves() const -> size_t {
+				return lurd.empty() ? 1 : lurd.size();
+			}
+
 		};
 
 		void maybe_do_next_turn() {
@@ -503,6 +710,7 @@ namespace sstm {
 
 			assert(controlled_pos == turn.get_controlled_pos_before());
 			controlled_pos = turn.get_controlled_pos_after();	
+			update_hint_search();
 			check_goals();
 		}
 
@@ -521,6 +729,7 @@ namespace sstm {
 
 			assert(controlled_pos == turn.get_controlled_pos_after());
 			controlled_pos = turn.get_controlled_pos_before();	
+			update_hint_search();
 			// check_goals();
 		}
 
@@ -553,6 +762,9 @@ namespace sstm {
 					changes.emplace_back(target_pos, Entity::Box, entity_at(controlled_pos));
 					changes.emplace_back(controlled_pos, entity_at(controlled_pos), Entity::Nothing);
 					changes.emplace_back(box_target, Entity::Nothing, Entity::Box);
+					if (maybe_board) {
+						warn_about_deadlock(to_cell(target_pos), to_cell(box_target));
+					}
 					apply(Turn{std::move(changes), controlled_pos, target_pos});
 				}
 				return;
@@ -566,6 +778,106 @@ namespace sstm {
 			}
 		}
 
+		//Called before a box moves from one cell to another, so it accounts for the box that is about to move.
+		void warn_about_deadlock(Cell from, Cell to) const {
+			assert(maybe_board);
+			auto is_box = [&](Cell cell) { return cell == to || (cell != from && is_box_at(cell)); };
+			if (maybe_board->is_dead_square(to)) {
+				std::cout << "Box pushed onto a dead square, this level cannot be solved anymore.\n";
+			} else if (is_freeze_deadlock(*maybe_board, to, is_box)) {
+				std::cout << "Box pushed into a frozen cluster off its goals, this level cannot be solved anymore.\n";
+			} else if (deadlock_patterns.is_dead(*maybe_board, to, is_box)) {
+				std::cout << "Boxes pushed into a dead pattern, this level cannot be solved anymore.\n";
+			}
+		}
+
+		//Pushes a box to another cell along the fewest pushes, walks included, as a single turn that is undone
+		//in one go. Returns false if the other boxes or the walls are in the way.
+		auto push_box_to(const glm::ivec3 &box_pos, const glm::ivec3 &target_pos) -> bool {
+			if (!maybe_board || !is_in_bounds(target_pos) || entity_at(box_pos) != Entity::Box) {
+				return false;
+			}
+
+			auto box = to_cell(box_pos);
+			auto occupied = std::vector<std::uint8_t>(maybe_board->number_of_cells());
+			for (auto cell = Cell{}; cell < maybe_board->number_of_cells(); ++cell) {
+				occupied[cell] = cell != box && !maybe_board->is_wall(cell) && is_box_at(cell);
+			}
+			auto maybe_lurd = plan_box_path(*maybe_board, std::move(occupied), to_cell(controlled_pos), box, to_cell(target_pos));
+			if (!maybe_lurd || maybe_lurd->empty()) {
+				return false;
+			}
+
+			//Plays the moves on a copy of the cells they touch and keeps the net changes.
+			auto entities = std::unordered_map<glm::ivec3, Entity>{};
+			auto entity_after = [&](const glm::ivec3 &pos) {
+				auto it = entities.find(pos);
+				return it == entities.end() ? entity_at(pos) : it->second;
+			};
+			auto translations = std::array{glm::ivec3{1, 0, 0}, glm::ivec3{-1, 0, 0}, glm::ivec3{0, 0, -1}, glm::ivec3{0, 0, 1}};
+			auto pos = controlled_pos;
+			for (auto c : *maybe_lurd) {
+				auto translation = translations[static_cast<size_t>(*from_lurd(c))];
+				auto next_pos = pos + translation;
+				if (entity_after(next_pos) == Entity::Box) {
+					assert(entity_after(next_pos + translation) == Entity::Nothing);
+					entities[next_pos + translation] = Entity::Box;
+				}
+				entities[next_pos] = entity_after(pos);
+				entities[pos] = Entity::Nothing;
+				pos = next_pos;
+			}
+
+			auto changes = std::vector<Change>{};
+			for (const auto &[changed_pos, entity] : entities) {
+				if (entity != entity_at(changed_pos)) {
+					changes.emplace_back(changed_pos, entity_at(changed_pos), entity);
+				}
+			}
+			warn_about_deadlock(box, to_cell(target_pos));
+			apply(Turn{std::move(changes), controlled_pos, pos, std::move(*maybe_lurd)});
+			return true;
+		}
+
+		//The cell a ray from the camera hits first: a box or a wall by its top face, otherwise the ground below.
+		[[nodiscard]] auto pick(const glm::vec3 &origin, const glm::vec3 &direction) const -> std::optional<glm::ivec3> {
+			if (direction.y >= 0.f) {
+				return std::nullopt;
+			}
+			auto pos_at_height = [&](float height) {
+				auto point = origin + direction * ((height - origin.y) / direction.y);
+				return glm::ivec3{static_cast<int>(std::floor(point.x)), 1, static_cast<int>(std::floor(point.z))};
+			};
+
+			auto top_pos = pos_at_height(2.f);
+			if (is_in_bounds(top_pos) && (entity_at(top_pos) == Entity::Box || entity_at(top_pos) == Entity::Wall)) {
+				return top_pos;
+			}
+			auto ground_pos = pos_at_height(1.f);
+			if (is_in_bounds(ground_pos)) {
+				return ground_pos;
+			}
+			return std::nullopt;
+		}
+
+		//A click on a box selects it, a click on any other cell pushes the selected box there.
+		void click(const glm::ivec3 &pos) {
+			if (!is_in_bounds(pos)) {
+				return;
+			}
+			if (entity_at(pos) == Entity::Box) {
+				maybe_selected_box = is_selected_box(pos) ? std::nullopt : std::optional{pos};
+				return;
+			}
+			if (maybe_selected_box && is_selected_box(*maybe_selected_box)) {
+				auto box_pos = *maybe_selected_box;
+				maybe_selected_box = std::nullopt;
+				if (!push_box_to(box_pos, pos)) {
+					std::cout << "The box cannot be pushed there.\n";
+				}
+			}
+		}
+
 		//TODO: easy to call load_level when transition is what we want.
 		void transition_to_level(size_t level_id) {
 			turns.erase(stdc::to_it(turns, next_turn_id), turns.end());
@@ -631,4 +943,6 @@ namespace sstm {
 
 
 
-} //namespace sstm
\ No newline at end of file
+} //namespace sstm
+
+BOOST_CLASS_VERSION(sstm::World::Turn, 1)
\ No newline at end of file
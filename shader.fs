@@ -17,6 +17,7 @@ uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 uniform Light light; 
 uniform vec3 viewPos;
+uniform vec3 tint;
 
 void main()
 {
@@ -37,5 +38,5 @@ void main()
     vec3 specular = light.specular * spec * texture(texture_specular1, TexCoords).rgb;  
         
     vec3 result = ambient + diffuse + specular;
-    FragColor = vec4(result, 1.0);
+    FragColor = vec4(result * tint, 1.0);
 } 
\ No newline at end of file
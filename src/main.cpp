@@ -9,10 +9,16 @@
 #include "shader.h"
 #include "model.h"
 #include "window.h"
+#include "headless.h"
 
 #include <iostream>
+#include <string_view>
+#include <vector>
 
-int main() try {
+int main(int argc, char *argv[]) try {
+	if (auto maybe_exit_code = sstm::run_headless(std::vector<std::string_view>(argv, argv + argc))) {
+		return *maybe_exit_code;
+	}
 	
 	//TODO: name duplication
 	stdc::fs::create_directory("saves");
@@ -47,6 +53,8 @@ int main() try {
 		// input
 		glfwPollEvents();
 		window.process_keyboard_input(deltaTime);
+		window.world_ptr->collect_optimized_solutions();
+		window.world_ptr->refresh_hint();
 
 		//TODO: No.
 		window.render(deltaTime);